@@ -0,0 +1,248 @@
+// cdbset_funcs.c: constant databases in the style of D. J.
+// Bernstein's cdb, read-only hash sets that are queried where they
+// lie in a file rather than loaded. hashset_save_cdb() writes the
+// elements of a hashset_t once; cdbset_open() maps the file and
+// cdbset_contains() probes the mapping directly, so nothing is built
+// in memory and a process can answer its first lookup as soon as the
+// file is open. Pages are read in by the lookups that touch them and
+// are shared through the page cache with every other process that has
+// the file open.
+//
+// After a small header the file holds a directory of CDBSET_BUCKETS
+// buckets, then the slots of every bucket one after another, then the
+// elements packed in insertion order. The low 8 bits of an element's
+// hashcode64() pick its bucket, which holds its own open addressing
+// table of twice as many slots as it has elements; the high 32 bits
+// pick the slot a lookup starts at, and it moves on to the next slot
+// of the bucket until it finds the element or an empty slot. A slot
+// carries more bits of the hash and the element's length, so only a
+// probable match touches the elements. A hit costs a read of the
+// directory, which stays cached, one or two slots and the element.
+// Like the other binary formats the file is only meant to be read on
+// machines with the same byte order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashset.h"
+
+// Identifies files written by hashset_save_cdb(); followed by the
+// rest of a cdbset_header_t
+static const char cdbset_magic[8] = "HSCDBSET";
+
+// Type for the header at the start of a constant database file, 32
+// bytes so the directory and slots after it are aligned in the
+// mapping
+typedef struct {
+  char magic[8];                // cdbset_magic
+  uint32_t version;             // CDBSET_FILE_VERSION
+  int32_t elem_count;           // number of elements
+  uint64_t slot_count;          // slots of all buckets
+  uint64_t keys_len;            // bytes of the packed elements at the end of the file
+} cdbset_header_t;
+
+// Maps `x` onto 0..range-1 using its high 32 bits, which avoids a
+// division.
+static uint32_t cdbset_range(uint64_t x, uint32_t range){
+  return (uint32_t) (((x >> 32) * range) >> 32);
+}
+
+// Writes the elements of `hs` to `filename` as a constant database
+// that cdbset_open() can query in place. Elements are hashed with
+// hashcode64() whatever the hash mode of `hs`. Buckets are filled one
+// at a time in a buffer the size of the bucket, so besides `hs` this
+// needs only 24 bytes per element and the largest bucket. Prints an
+// error if the file cannot be opened.
+void hashset_save_cdb(hashset_t *hs, char *filename){
+  FILE *file = fopen(filename, "wb");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  int count = hs->elem_count;
+  uint64_t *hashes = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+  uint64_t *offs = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+  int32_t *lens = malloc(sizeof(int32_t) * (count > 0 ? count : 1));
+  uint64_t keys_len = 0;
+  int e = 0;
+  for(int i = 1; i <= hs->node_count; i++){       // present elements in insertion order
+    hashnode_t *node = &hs->nodes[i];
+    if(node->elem_len >= 0){
+      hashes[e] = hashcode64(hs->keys.bytes + node->elem_off, node->elem_len);
+      offs[e] = keys_len;
+      lens[e] = node->elem_len;
+      keys_len += node->elem_len + 1;
+      e++;
+    }
+  }
+
+  cdbdir_t dir[CDBSET_BUCKETS];                   // count each bucket's elements, then lay out the buckets
+  uint64_t slot_count = 0;
+  uint64_t max_len = 0;
+  memset(dir, 0, sizeof(dir));
+  for(int i = 0; i < count; i++){
+    dir[hashes[i] & (CDBSET_BUCKETS - 1)].len += 2;
+  }
+  for(int b = 0; b < CDBSET_BUCKETS; b++){
+    dir[b].start = slot_count;
+    slot_count += dir[b].len;
+    if(dir[b].len > max_len){
+      max_len = dir[b].len;
+    }
+  }
+  uint32_t *order = malloc(sizeof(uint32_t) * (count > 0 ? count : 1)); // elements grouped by bucket
+  uint64_t fill[CDBSET_BUCKETS];
+  for(int b = 0; b < CDBSET_BUCKETS; b++){
+    fill[b] = dir[b].start / 2;
+  }
+  for(int i = 0; i < count; i++){
+    order[fill[hashes[i] & (CDBSET_BUCKETS - 1)]++] = i;
+  }
+
+  cdbset_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, cdbset_magic, sizeof(header.magic));
+  header.version = CDBSET_FILE_VERSION;
+  header.elem_count = count;
+  header.slot_count = slot_count;
+  header.keys_len = keys_len;
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(dir, sizeof(cdbdir_t), CDBSET_BUCKETS, file);
+
+  cdbslot_t *slots = malloc(sizeof(cdbslot_t) * (max_len > 0 ? max_len : 1));
+  for(int b = 0; b < CDBSET_BUCKETS; b++){
+    uint64_t len = dir[b].len;
+    for(uint64_t s = 0; s < len; s++){
+      slots[s].hash = 0;
+      slots[s].elem_len = -1;
+      slots[s].elem_off = 0;
+    }
+    uint32_t *elems = order + dir[b].start / 2;
+    for(uint64_t j = 0; j < len / 2; j++){
+      int i = elems[j];
+      uint64_t s = cdbset_range(hashes[i], (uint32_t) len); // at most 2 * INT_MAX so it fits
+      while(slots[s].elem_len >= 0){              // half the slots are empty so this ends
+        s = s + 1 == len ? 0 : s + 1;
+      }
+      slots[s].hash = (uint32_t) (hashes[i] >> 8);
+      slots[s].elem_len = lens[i];
+      slots[s].elem_off = offs[i];
+    }
+    fwrite(slots, sizeof(cdbslot_t), len, file);
+  }
+  for(int i = 1; i <= hs->node_count; i++){
+    hashnode_t *node = &hs->nodes[i];
+    if(node->elem_len >= 0){
+      fwrite(hs->keys.bytes + node->elem_off, 1, node->elem_len + 1, file);
+    }
+  }
+  fclose(file);
+  free(slots);
+  free(order);
+  free(lens);
+  free(offs);
+  free(hashes);
+}
+
+// Opens the constant database in `filename` as `cdb` by mapping it
+// with mmap(). Only the header and directory are checked, so this
+// takes the same time for any size of file; lookups check each slot
+// they use refers within the elements. The mapping is advised for
+// random access as lookups jump around the file. Prints an error and
+// returns 0 if the file cannot be opened or is not a constant
+// database of this version with a consistent length and directory;
+// otherwise returns 1. Close it with cdbset_close().
+int cdbset_open(cdbset_t *cdb, char *filename){
+  cdb->map = NULL;
+  int fd = open(filename, O_RDONLY);
+  if(fd == -1){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  size_t prefix = sizeof(cdbset_header_t) + sizeof(cdbdir_t) * CDBSET_BUCKETS;
+  struct stat st;
+  char *map = MAP_FAILED;
+  if(fstat(fd, &st) == 0 && st.st_size >= (off_t) prefix){
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);                                      // the mapping stays valid
+  cdbset_header_t header;
+  int ok = map != MAP_FAILED;
+  if(ok){
+    memcpy(&header, map, sizeof(header));
+    ok = memcmp(header.magic, cdbset_magic, sizeof(header.magic)) == 0 &&
+      header.version == CDBSET_FILE_VERSION;
+  }
+  if(!ok){
+    printf("ERROR: '%s' is not a constant database file\n", filename);
+    if(map != MAP_FAILED){
+      munmap(map, st.st_size);
+    }
+    return 0;
+  }
+  uint64_t rest = st.st_size - prefix;
+  ok = header.elem_count >= 0 && header.slot_count <= rest / sizeof(cdbslot_t) &&
+    rest == header.slot_count * sizeof(cdbslot_t) + header.keys_len;
+  cdbdir_t *dir = (cdbdir_t *) (map + sizeof(cdbset_header_t));
+  for(int b = 0; ok && b < CDBSET_BUCKETS; b++){  // buckets must lie within the slots
+    ok = dir[b].len <= UINT32_MAX && dir[b].start <= header.slot_count &&
+      dir[b].len <= header.slot_count - dir[b].start;
+  }
+  if(!ok){
+    printf("ERROR: constant database file '%s' is truncated or damaged\n", filename);
+    munmap(map, st.st_size);
+    return 0;
+  }
+  madvise(map, st.st_size, MADV_RANDOM);
+  cdb->map = map;
+  cdb->map_len = st.st_size;
+  cdb->elem_count = header.elem_count;
+  cdb->dir = dir;
+  cdb->slots = (cdbslot_t *) (map + prefix);
+  cdb->keys = (char *) (cdb->slots + header.slot_count);
+  cdb->keys_len = header.keys_len;
+  return 1;
+}
+
+// Returns 1 if `elem` is in the constant database `cdb` and 0
+// otherwise, probing the slots of its bucket from the one its hash
+// picks. Stops at an empty slot or, in a damaged file without one,
+// after every slot of the bucket.
+int cdbset_contains(cdbset_t *cdb, char elem[]){
+  int len = strlen(elem);
+  uint64_t hash = hashcode64(elem, len);
+  cdbdir_t *bucket = &cdb->dir[hash & (CDBSET_BUCKETS - 1)];
+  uint32_t slot_len = bucket->len;
+  if(slot_len == 0){
+    return 0;
+  }
+  cdbslot_t *slots = cdb->slots + bucket->start;
+  uint32_t check = (uint32_t) (hash >> 8);
+  uint32_t s = cdbset_range(hash, slot_len);
+  for(uint32_t i = 0; i < slot_len; i++){
+    cdbslot_t *slot = &slots[s];
+    if(slot->elem_len < 0){
+      return 0;
+    }
+    if(slot->hash == check && slot->elem_len == len &&
+       slot->elem_off < cdb->keys_len && (uint64_t) len < cdb->keys_len - slot->elem_off &&
+       memcmp(cdb->keys + slot->elem_off, elem, len) == 0){
+      return 1;
+    }
+    s = s + 1 == slot_len ? 0 : s + 1;
+  }
+  return 0;
+}
+
+// Unmaps the file of `cdb`. Does nothing if none is open.
+void cdbset_close(cdbset_t *cdb){
+  if(cdb->map != NULL){
+    munmap(cdb->map, cdb->map_len);
+    cdb->map = NULL;
+  }
+}
@@ -0,0 +1,462 @@
+// ckset_funcs.c: a hash set using cuckoo hashing. Each element has
+// exactly one possible slot in each of two tables, picked by
+// siphash13() under a separate seed for each table, so a lookup
+// examines at most two slots plus a small stash no matter how keys are
+// distributed. An add that finds both slots taken evicts an occupant
+// to its slot in the other table, and so on, until an empty slot turns
+// up; if that takes too long the element left over goes to the stash.
+// Once the stash is full every element is placed again under new
+// random seeds, so keys crafted to collide under one seed don't under
+// the next, and only if a few seeds fail are the tables grown. Placing
+// gives up after a bounded number of seeds and sizes.
+// Provides the same operations as the chained hash set in
+// hashset_funcs.c and keeps elements in insertion order like the
+// other open addressing sets.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "hashset.h"
+
+// Seeds every cuckoo set starts with, so that its structure is the
+// same from run to run until placing fails and it picks random ones
+static const uint64_t ckset_initial_seed[2][2] = {
+  {0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL},
+  {0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL},
+};
+
+// Stores in `hash` the hash of the `len` character string `elem` for
+// each table of `ck`: siphash13() under that table's seed, so the two
+// slots of an element are independent of each other.
+static void ckset_hash(ckset_t *ck, char elem[], int len, uint64_t hash[2]){
+  hash[0] = siphash13(elem, len, ck->seed[0][0], ck->seed[0][1]);
+  hash[1] = siphash13(elem, len, ck->seed[1][0], ck->seed[1][1]);
+}
+
+// Replaces the seeds of `ck` with `seed`, or with random ones if
+// `seed` is NULL, and rehashes every element under them.
+static void ckset_set_seed(ckset_t *ck, const uint64_t seed[2][2]){
+  if(seed == NULL){
+    hashset_random_seed(ck->seed[0]);
+    hashset_random_seed(ck->seed[1]);
+  }else{
+    memcpy(ck->seed, seed, sizeof(ck->seed));
+  }
+  for(int i = 0; i < ck->elem_count; i++){
+    ckentry_t *entry = &ck->entries[i];
+    ckset_hash(ck, ck->keys.bytes + entry->elem_off, entry->elem_len, entry->hash);
+  }
+}
+
+// Allocates two empty tables of `table_size/2` slots each for `ck` and
+// empties the stash. Does not free any previous tables.
+static void ckset_alloc_tables(ckset_t *ck, int table_size){
+  ck->table_size = table_size;
+  ck->tables[0] = calloc(table_size / 2, sizeof(uint32_t));
+  ck->tables[1] = calloc(table_size / 2, sizeof(uint32_t));
+  ck->stash_count = 0;
+}
+
+// Initialize the cuckoo set `ck` to have at least `table_size` slots
+// in total, rounded up to a power of two and at least
+// CKSET_MIN_TABLE_SIZE, and no elements. The maximum load factor
+// starts at CKSET_DEFAULT_MAX_LOAD and the seeds at
+// ckset_initial_seed.
+void ckset_init(ckset_t *ck, int table_size){
+  int size = CKSET_MIN_TABLE_SIZE;
+  while(size < table_size){
+    size *= 2;
+  }
+  ckset_alloc_tables(ck, size);
+  ck->elem_count = 0;
+  ck->max_load = CKSET_DEFAULT_MAX_LOAD;
+  memcpy(ck->seed, ckset_initial_seed, sizeof(ck->seed));
+  ck->entries = NULL;
+  ck->entries_cap = 0;
+  ck->keys.bytes = NULL;
+  ck->keys.len = 0;
+  ck->keys.cap = 0;
+}
+
+// Returns the slot in table `t` for an element with hashes `hash`:
+// the low bits of its hash for that table.
+static int ckset_slot(ckset_t *ck, int t, uint64_t hash[2]){
+  return hash[t] & (ck->table_size / 2 - 1);
+}
+
+// Returns 1 if `ref`, 1 + an index in `entries`, refers to the `len`
+// character string `elem` whose hash for table 0 is `hash0` and 0
+// otherwise, including when `ref` is 0 for an empty slot.
+static int ckset_matches(ckset_t *ck, uint32_t ref, char elem[], int len, uint64_t hash0){
+  if(ref == 0){
+    return 0;
+  }
+  ckentry_t *entry = &ck->entries[ref - 1];
+  return entry->hash[0] == hash0 && entry->elem_len == len &&
+    memcmp(ck->keys.bytes + entry->elem_off, elem, len) == 0;
+}
+
+// Returns the number of places searched looking for the `len`
+// character string `elem` whose hash for table 0 is in hash[0]: 1 or
+// 2 if it is found in table 0 or 1, 2 plus its position if it is in
+// the stash, and 2 plus the number of stashed elements if it is not
+// present. Sets `found` to 1 or 0 according to whether it is present.
+// The hash for table 1 is only computed, into hash[1], once table 0
+// doesn't hold the element, so it is always there when `found` is 0.
+static int ckset_search(ckset_t *ck, char elem[], int len, uint64_t hash[2], int *found){
+  *found = 1;
+  if(ckset_matches(ck, ck->tables[0][ckset_slot(ck, 0, hash)], elem, len, hash[0])){
+    return 1;
+  }
+  hash[1] = siphash13(elem, len, ck->seed[1][0], ck->seed[1][1]);
+  if(ckset_matches(ck, ck->tables[1][ckset_slot(ck, 1, hash)], elem, len, hash[0])){
+    return 2;
+  }
+  for(int i = 0; i < ck->stash_count; i++){
+    if(ckset_matches(ck, ck->stash[i], elem, len, hash[0])){
+      return 3 + i;
+    }
+  }
+  *found = 0;
+  return 2 + ck->stash_count;
+}
+
+// Places the element `ref`, 1 + its index in `entries`, into one of
+// the tables. Takes an empty slot of the two for the element if there
+// is one, otherwise evicts the occupant of its table 0 slot and moves
+// it to its slot in the other table, evicting that slot's occupant in
+// turn, up to CKSET_MAX_KICKS times. Returns 0 if every element found
+// a slot, otherwise the one left without a slot. Each slot evicted
+// from is recorded in `moved`, room for CKSET_MAX_KICKS, in the order
+// they were written, so ckset_insert() can put the evictions back.
+static uint32_t ckset_place(ckset_t *ck, uint32_t ref, uint32_t *moved[]){
+  uint64_t *hash = ck->entries[ref - 1].hash;
+  for(int t = 0; t < 2; t++){
+    uint32_t *slot = &ck->tables[t][ckset_slot(ck, t, hash)];
+    if(*slot == 0){
+      *slot = ref;
+      return 0;
+    }
+  }
+  int t = 0;
+  for(int kicks = 0; kicks < CKSET_MAX_KICKS && ref != 0; kicks++){
+    uint32_t *slot = &ck->tables[t][ckset_slot(ck, t, ck->entries[ref - 1].hash)];
+    uint32_t evicted = *slot;
+    moved[kicks] = slot;
+    *slot = ref;
+    ref = evicted;                              // evicted element's other slot is in the other table
+    t = 1 - t;
+  }
+  return ref;
+}
+
+// Places the element `ref` into the tables, putting whichever element
+// is left without a slot into the stash. Returns 1 on success or 0 if
+// the stash is full, in which case the tables must be rebuilt larger.
+// On failure every eviction is undone, last first, so the tables hold
+// exactly what they did before and `ref` is in neither.
+static int ckset_insert(ckset_t *ck, uint32_t ref){
+  uint32_t *moved[CKSET_MAX_KICKS];
+  uint32_t homeless = ckset_place(ck, ref, moved);
+  if(homeless == 0){
+    return 1;
+  }
+  if(ck->stash_count == CKSET_STASH_SIZE){
+    for(int k = CKSET_MAX_KICKS - 1; k >= 0; k--){ // a homeless element means every kick was used
+      uint32_t evicted = homeless;
+      homeless = *moved[k];
+      *moved[k] = evicted;
+    }
+    return 0;                                   // `homeless` is `ref` again, which was written first
+  }
+  ck->stash[ck->stash_count] = homeless;
+  ck->stash_count++;
+  return 1;
+}
+
+// Replaces the tables of `ck` with empty ones of `new_size` total
+// slots and places every element again in insertion order using its
+// cached hashes. Returns 1 on success. Should the stash overflow, the
+// new tables are dropped, the old tables and stash are put back
+// unchanged and 0 is returned.
+static int ckset_place_all(ckset_t *ck, int new_size){
+  uint32_t *old_tables[2] = {ck->tables[0], ck->tables[1]};
+  uint32_t old_stash[CKSET_STASH_SIZE];
+  memcpy(old_stash, ck->stash, sizeof(old_stash));
+  int old_stash_count = ck->stash_count;
+  int old_size = ck->table_size;
+  ckset_alloc_tables(ck, new_size);
+  int i = 0;
+  while(i < ck->elem_count && ckset_insert(ck, i + 1)){
+    i++;
+  }
+  if(i == ck->elem_count){
+    free(old_tables[0]);
+    free(old_tables[1]);
+    return 1;
+  }
+  free(ck->tables[0]);
+  free(ck->tables[1]);
+  ck->tables[0] = old_tables[0];
+  ck->tables[1] = old_tables[1];
+  memcpy(ck->stash, old_stash, sizeof(old_stash));
+  ck->stash_count = old_stash_count;
+  ck->table_size = old_size;
+  return 0;
+}
+
+// Places every element of `ck` again in tables of `new_size` total
+// slots, trying the current seeds first unless `new_size` is the
+// current size, as they have just failed there, and then up to
+// CKSET_MAX_RESEEDS random ones. If none of them fits every element
+// the size is doubled and the seeds tried again, up to
+// CKSET_MAX_GROWS times. Returns 1 on success. If every attempt fails
+// returns 0 with the tables, stash and seeds of `ck` as they were, so
+// the cost of placing is bounded even for keys chosen to collide.
+static int ckset_resize(ckset_t *ck, int new_size){
+  uint64_t old_seed[2][2];
+  memcpy(old_seed, ck->seed, sizeof(old_seed));
+  int reseed = new_size == ck->table_size;
+  for(int grows = 0; grows <= CKSET_MAX_GROWS; grows++){
+    for(int tries = 0; tries <= CKSET_MAX_RESEEDS; tries++){
+      if(reseed){
+        ckset_set_seed(ck, NULL);
+      }
+      reseed = 1;
+      if(ckset_place_all(ck, new_size)){
+        return 1;
+      }
+    }
+    if(new_size > INT_MAX / 2){
+      break;
+    }
+    new_size *= 2;
+  }
+  ckset_set_seed(ck, old_seed);
+  return 0;
+}
+
+// Doubles the number of slots of `ck` and re-places every element.
+// Returns 1 on success and 0, leaving `ck` unchanged, if it can't grow
+// further or placing fails; see ckset_resize().
+static int ckset_grow(ckset_t *ck){
+  if(ck->table_size > INT_MAX / 2){
+    return 0;
+  }
+  return ckset_resize(ck, ck->table_size * 2);
+}
+
+// Doubles the number of slots of `ck` and re-places every element.
+// Leaves `ck` unchanged in the unlikely case that placing fails.
+void ckset_expand(ckset_t *ck){
+  ckset_grow(ck);
+}
+
+// Sets the load factor past which ckset_add() expands `ck`. Inserts
+// into cuckoo tables with one slot per bucket start failing near half
+// full so expansion can't be turned off: values of 0 or less select
+// CKSET_DEFAULT_MAX_LOAD and values above CKSET_MAX_MAX_LOAD are
+// capped. Expands right away if `ck` is already over the new limit.
+void ckset_set_max_load(ckset_t *ck, double max_load){
+  if(max_load <= 0){
+    max_load = CKSET_DEFAULT_MAX_LOAD;
+  }
+  if(max_load > CKSET_MAX_MAX_LOAD){
+    max_load = CKSET_MAX_MAX_LOAD;
+  }
+  ck->max_load = max_load;
+  while(ck->elem_count > ck->max_load * ck->table_size && ckset_grow(ck)){
+    // grow until under the limit or it can't grow
+  }
+}
+
+// Returns 1 if `elem` is in `ck` and 0 otherwise.
+int ckset_contains(ckset_t *ck, char elem[]){
+  int len = strlen(elem);
+  uint64_t hash[2] = {siphash13(elem, len, ck->seed[0][0], ck->seed[0][1]), 0};
+  int found;
+  ckset_search(ck, elem, len, hash, &found);
+  return found;
+}
+
+// Returns the number of places a lookup of `elem` examines, counting
+// each table slot and stash entry; see ckset_search().
+int ckset_probe_count(ckset_t *ck, char elem[]){
+  int len = strlen(elem);
+  uint64_t hash[2] = {siphash13(elem, len, ck->seed[0][0], ck->seed[0][1]), 0};
+  int found;
+  return ckset_search(ck, elem, len, hash, &found);
+}
+
+// Adds `elem` to `ck` and returns 1 or returns 0 if it is already
+// present. The element is appended to the `entries` array, which is
+// doubled as needed, and its string to the `keys` arena. If holding
+// one more element would exceed `max_load` the tables are expanded
+// first. If the element can't be placed with the stash full, every
+// element is placed again under new seeds, growing the tables if need
+// be, as ckset_resize() describes. The failed insert undoes its
+// evictions and a failed resize keeps the tables it started with, so
+// should that fail too the element is simply not added, `ck` is left
+// as it was and -1 is returned.
+int ckset_add(ckset_t *ck, char elem[]){
+  int len = strlen(elem);
+  uint64_t hash[2] = {siphash13(elem, len, ck->seed[0][0], ck->seed[0][1]), 0};
+  int found;
+  ckset_search(ck, elem, len, hash, &found);
+  if(found){
+    return 0;
+  }
+  int grew = 0;
+  while(ck->elem_count + 1 > ck->max_load * ck->table_size && ckset_grow(ck)){
+    grew = 1;                                   // grow until under the limit or it can't grow
+  }
+  if(ck->elem_count == ck->entries_cap){
+    ck->entries_cap = ck->entries_cap == 0 ? RHSET_MIN_ENTRIES : ck->entries_cap * 2;
+    ck->entries = realloc(ck->entries, sizeof(ckentry_t) * ck->entries_cap);
+  }
+  ckentry_t *entry = &ck->entries[ck->elem_count];
+  entry->elem_off = strarena_add(&ck->keys, elem, len);
+  entry->elem_len = len;
+  if(grew){
+    ckset_hash(ck, elem, len, hash);            // growing may have changed the seeds
+  }
+  entry->hash[0] = hash[0];
+  entry->hash[1] = hash[1];
+  ck->elem_count++;
+  if(!ckset_insert(ck, ck->elem_count) && !ckset_resize(ck, ck->table_size)){
+    ck->elem_count--;                          // the tables never took the element, drop it
+    ck->keys.len = entry->elem_off;
+    return -1;
+  }
+  return 1;
+}
+
+// De-allocates the tables, entries and string arena of `ck` and sets
+// its fields to indicate it has no usable space. Does NOT free `ck`
+// itself.
+void ckset_free_fields(ckset_t *ck){
+  free(ck->tables[0]);
+  free(ck->tables[1]);
+  ck->tables[0] = NULL;
+  ck->tables[1] = NULL;
+  ck->stash_count = 0;
+  free(ck->entries);
+  ck->entries = NULL;
+  ck->entries_cap = 0;
+  strarena_free(&ck->keys);
+  ck->elem_count = 0;
+  ck->table_size = 0;
+}
+
+// Outputs all elements of `ck` in the order they were added, each on
+// its own line preceded by its add position, in the same format as
+// hashset_write_elems_ordered().
+void ckset_write_elems_ordered(ckset_t *ck, FILE *out){
+  for(int i = 0; i < ck->elem_count; i++){
+    fprintf(out, "   %d %s\n", i+1, ck->keys.bytes + ck->entries[i].elem_off);
+  }
+}
+
+// Displays detailed structure of `ck`: the same stats as
+// hashset_show_structure() followed by the slots of each table and
+// the stash:
+//
+// table 1:
+// [ 2] : {Summer}
+void ckset_show_structure(ckset_t *ck){
+  printf("elem_count: %d\n", ck->elem_count);
+  printf("table_size: %d\n", ck->table_size);
+  if(ck->elem_count == 0){
+    printf("order_first: NULL\n");
+    printf("order_last : NULL\n");
+  }else{
+    printf("order_first: %s\n", ck->keys.bytes + ck->entries[0].elem_off);
+    printf("order_last : %s\n", ck->keys.bytes + ck->entries[ck->elem_count-1].elem_off);
+  }
+  printf("load_factor: %.4f\n", (double) ck->elem_count / ck->table_size);
+  for(int t = 0; t < 2; t++){
+    printf("table %d:\n", t);
+    for(int i = 0; i < ck->table_size / 2; i++){
+      uint32_t ref = ck->tables[t][i];
+      if(ref == 0){
+        printf("[%2d] :\n", i);
+      }else{
+        printf("[%2d] : {%s}\n", i, ck->keys.bytes + ck->entries[ref - 1].elem_off);
+      }
+    }
+  }
+  printf("stash: %d\n", ck->stash_count);
+  for(int i = 0; i < ck->stash_count; i++){
+    printf("[%2d] : {%s}\n", i, ck->keys.bytes + ck->entries[ck->stash[i] - 1].elem_off);
+  }
+}
+
+// Writes `ck` to `filename` in the format of hashset_save() so the
+// files of any implementation can be loaded by the others.
+void ckset_save(ckset_t *ck, char *filename){
+  FILE *file = fopen(filename, "w");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  fprintf(file, "%d %d\n", ck->table_size, ck->elem_count);
+  ckset_write_elems_ordered(ck, file);
+  fclose(file);
+}
+
+// Loads a file written by any implementation's save into `ck`,
+// replacing its contents. Prints an error and returns 0 if the file
+// cannot be opened, otherwise returns 1. The tables are sized up front
+// from the header to hold every element under the current `max_load`,
+// which is kept.
+int ckset_load(ckset_t *ck, char *filename){
+  FILE *file = fopen(filename, "r");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  int size, count;
+  uint64_t seed[2];                             // a cuckoo set keeps its own seeds, ignored
+  hashset_read_header(file, &size, &count, seed);
+  double max_load = ck->max_load;
+  ckset_free_fields(ck);
+  ckset_init(ck, size);
+  ckset_set_max_load(ck, max_load);
+  int new_size = ck->table_size;
+  while(count > ck->max_load * new_size && new_size <= INT_MAX / 2){
+    new_size *= 2;
+  }
+  if(new_size != ck->table_size){
+    ckset_resize(ck, new_size);
+  }
+  char *line = NULL;
+  size_t line_cap = 0;
+  char *elem;
+  for(int i = 0; i < count && hashset_read_elem(file, &line, &line_cap, &elem) >= 0; i++){
+    ckset_add(ck, elem);
+  }
+  free(line);
+  fclose(file);
+  return 1;
+}
+
+// Adapters from the generic hashset_ops_t interface to the functions
+// above.
+static void ops_init(void *set, int table_size){ ckset_init(set, table_size); }
+static int  ops_add(void *set, char elem[]){ return ckset_add(set, elem); }
+static int  ops_contains(void *set, char elem[]){ return ckset_contains(set, elem); }
+static void ops_expand(void *set){ ckset_expand(set); }
+static void ops_set_max_load(void *set, double max_load){ ckset_set_max_load(set, max_load); }
+static void ops_free_fields(void *set){ ckset_free_fields(set); }
+static void ops_write_elems_ordered(void *set, FILE *out){ ckset_write_elems_ordered(set, out); }
+static void ops_show_structure(void *set){ ckset_show_structure(set); }
+static void ops_save(void *set, char *filename){ ckset_save(set, filename); }
+static int  ops_load(void *set, char *filename){ return ckset_load(set, filename); }
+
+hashset_ops_t ckset_ops = {
+  "cuckoo", sizeof(ckset_t),
+  ops_init, ops_add, ops_contains, ops_expand, ops_set_max_load, ops_free_fields,
+  ops_write_elems_ordered, ops_show_structure, ops_save, ops_load,
+};
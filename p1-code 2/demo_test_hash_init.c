@@ -26,11 +26,11 @@ int main(int argc, char *argv[]){
     return 1;
   }
 
-  for(int i=0; i<hashset.table_size; i++){                // check all table entries have been NULL'ed
-    if( hashset.table[i] != NULL ){
+  for(int i=0; i<hashset.table_size; i++){                // check all table entries are empty (0)
+    if( hashset.table[i] != 0 ){
       printf("table[%d] wrong\n",i);
-      printf("Expect: %p\n",NULL);
-      printf("Actual: %p\n",hashset.table[i]);
+      printf("Expect: %u\n",0);
+      printf("Actual: %u\n",hashset.table[i]);
       return 1;
     }
   }
@@ -0,0 +1,354 @@
+// frozenset_funcs.c: read-only hash sets built once from a populated
+// hashset_t by hashset_freeze(). Elements are placed with a minimal
+// perfect hash in the style of CHD ("compress, hash and displace"):
+// every element hashes to one of a small number of buckets and each
+// bucket stores a seed chosen while building so that the elements of
+// all buckets land on distinct slots of a table with exactly one slot
+// per element. A lookup reads the seed of its bucket, computes its
+// slot and compares against the single element there; there are no
+// chains, probes or empty slots. Seeds are searched over a few
+// percent more positions than there are slots, which keeps the last
+// buckets from trying very many seeds to find the final free slots,
+// and the few elements landing past the end are moved to the slots
+// left empty and found through a small remap table. A frozen set
+// can't be added to but can be saved to and loaded from a binary file
+// so readers skip building it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "hashset.h"
+
+// Identifies files written by frozenset_save(); followed by the
+// format version
+static const char frozenset_magic[8] = "HSFROZEN";
+
+// Initialize `fz` to be an empty frozen set which contains nothing.
+void frozenset_init(frozenset_t *fz){
+  fz->elem_count = 0;
+  fz->bucket_count = 0;
+  fz->position_count = 0;
+  fz->seeds = NULL;
+  fz->remap = NULL;
+  fz->slots = NULL;
+  fz->keys.bytes = NULL;
+  fz->keys.len = 0;
+  fz->keys.cap = 0;
+}
+
+// Maps `x` onto 0..range-1 using its high 32 bits, which avoids a
+// division.
+static uint32_t frozenset_range(uint64_t x, uint32_t range){
+  return (uint32_t) (((x >> 32) * range) >> 32);
+}
+
+// Returns the bucket of an element whose hashcode64() is `hash`.
+static uint32_t frozenset_bucket(frozenset_t *fz, uint64_t hash){
+  return frozenset_range(hash, fz->bucket_count);
+}
+
+// Returns the position of an element whose hashcode64() is `hash`
+// when its bucket has seed `seed`. Mixes the two with the splitmix64
+// finalizer so that each seed gives an unrelated position.
+static uint32_t frozenset_position(frozenset_t *fz, uint64_t hash, uint32_t seed){
+  uint64_t x = hash + (seed + 1) * 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return frozenset_range(x, fz->position_count);
+}
+
+// Builds the frozen set `fz` holding the elements of `hs`; `fz` should
+// not have storage of its own, see frozenset_free_fields(). Elements
+// are grouped into about elem_count/FROZENSET_BUCKET_ELEMS buckets and
+// buckets are handled largest first, trying seeds 0, 1, 2... for each
+// until one sends all its elements to positions no earlier bucket
+// took. Elements at positions past the last slot are then moved to
+// the empty slots.
+// Returns 1 on success or 0, leaving `fz` empty, if two elements have
+// the same 64-bit hash as no seed can separate them. `hs` is not
+// changed.
+int hashset_freeze(hashset_t *hs, frozenset_t *fz){
+  frozenset_init(fz);
+  int count = hs->elem_count;
+  fz->elem_count = count;
+  fz->bucket_count = count / FROZENSET_BUCKET_ELEMS + 1;
+  fz->position_count = count + count / FROZENSET_SPARE_DIV + 1;
+  fz->seeds = calloc(fz->bucket_count, sizeof(uint32_t));
+  fz->slots = malloc(sizeof(rhentry_t) * fz->position_count);
+
+  // copy elements into the arena in insertion order noting their hash
+  rhentry_t *entries = malloc(sizeof(rhentry_t) * (count > 0 ? count : 1));
+  uint64_t *hashes = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+  int i = 0;
+  for(int n = 1; n <= hs->node_count; n++){
+    hashnode_t *node = &hs->nodes[n];
+    if(node->elem_len < 0){                     // removed from `hs`
+      continue;
+    }
+    char *elem = hs->keys.bytes + node->elem_off;
+    hashes[i] = hashcode64(elem, node->elem_len);
+    entries[i].elem_off = strarena_add(&fz->keys, elem, node->elem_len);
+    entries[i].elem_len = node->elem_len;
+    entries[i].hash = (uint32_t) hashes[i];
+    i++;
+  }
+
+  // group element indices by bucket: `members` holds each bucket's
+  // elements starting at `start[b]`
+  int nb = fz->bucket_count;
+  int *start = calloc(nb + 1, sizeof(int));
+  int *members = malloc(sizeof(int) * (count > 0 ? count : 1));
+  for(i = 0; i < count; i++){
+    start[frozenset_bucket(fz, hashes[i]) + 1]++;
+  }
+  int max_size = 0;
+  for(int b = 0; b < nb; b++){
+    if(start[b+1] > max_size){
+      max_size = start[b+1];
+    }
+    start[b+1] += start[b];
+  }
+  int *fill = malloc(sizeof(int) * nb);
+  memcpy(fill, start, sizeof(int) * nb);
+  for(i = 0; i < count; i++){
+    members[fill[frozenset_bucket(fz, hashes[i])]++] = i;
+  }
+
+  // order buckets largest first with a counting sort on their size
+  int *by_size = malloc(sizeof(int) * nb);
+  int *size_start = calloc(max_size + 2, sizeof(int));
+  for(int b = 0; b < nb; b++){
+    size_start[max_size - (start[b+1] - start[b]) + 1]++;
+  }
+  for(int s = 0; s <= max_size; s++){
+    size_start[s+1] += size_start[s];
+  }
+  for(int b = 0; b < nb; b++){
+    by_size[size_start[max_size - (start[b+1] - start[b])]++] = b;
+  }
+
+  // find a seed for each bucket, marking the slots it takes in a
+  // bitmap; the last buckets try many seeds against it so it is kept
+  // small enough to stay in cache
+  uint64_t *taken = calloc(fz->position_count / 64 + 1, sizeof(uint64_t));
+  uint32_t *pos = malloc(sizeof(uint32_t) * (max_size > 0 ? max_size : 1));
+  int ok = 1;
+  for(int k = 0; k < nb && ok; k++){
+    int b = by_size[k];
+    int size = start[b+1] - start[b];
+    if(size == 0){
+      break;                                    // the remaining buckets are empty too
+    }
+    for(int j = 0; j < size && ok; j++){        // no seed separates equal hashes
+      for(int l = j+1; l < size; l++){
+        if(hashes[members[start[b] + j]] == hashes[members[start[b] + l]]){
+          ok = 0;
+        }
+      }
+    }
+    if(!ok){
+      break;
+    }
+    uint32_t seed;
+    for(seed = 0; ; seed++){
+      int j;
+      for(j = 0; j < size; j++){
+        pos[j] = frozenset_position(fz, hashes[members[start[b] + j]], seed);
+        uint64_t bit = 1ULL << (pos[j] % 64);
+        if(taken[pos[j] / 64] & bit){
+          break;
+        }
+        taken[pos[j] / 64] |= bit;              // also catches two elements of the bucket colliding
+      }
+      if(j == size){
+        break;
+      }
+      while(j > 0){                             // undo the partial placement and try the next seed
+        j--;
+        taken[pos[j] / 64] &= ~(1ULL << (pos[j] % 64));
+      }
+    }
+    fz->seeds[b] = seed;
+    for(int j = 0; j < size; j++){
+      fz->slots[pos[j]] = entries[members[start[b] + j]];
+    }
+  }
+
+  // move elements past the last slot into the empty slots, pairing
+  // them off in order
+  int spare = fz->position_count - count;
+  fz->remap = malloc(sizeof(uint32_t) * spare);
+  int empty = 0;
+  for(int p = count; p < fz->position_count && ok; p++){
+    fz->remap[p - count] = 0;
+    if(taken[p / 64] & (1ULL << (p % 64))){
+      while(taken[empty / 64] & (1ULL << (empty % 64))){
+        empty++;
+      }
+      fz->slots[empty] = fz->slots[p];
+      fz->remap[p - count] = empty;
+      empty++;
+    }
+  }
+
+  free(pos);
+  free(taken);
+  free(size_start);
+  free(by_size);
+  free(fill);
+  free(members);
+  free(start);
+  free(hashes);
+  free(entries);
+  if(!ok){
+    frozenset_free_fields(fz);
+  }
+  return ok;
+}
+
+// Returns 1 if `elem` is in the frozen set `fz` and 0 otherwise. Looks
+// at exactly one slot, going through `remap` for the few positions
+// past the last slot.
+int frozenset_contains(frozenset_t *fz, char elem[]){
+  if(fz->elem_count == 0){
+    return 0;
+  }
+  int len = strlen(elem);
+  uint64_t hash = hashcode64(elem, len);
+  uint32_t seed = fz->seeds[frozenset_bucket(fz, hash)];
+  uint32_t pos = frozenset_position(fz, hash, seed);
+  if(pos >= (uint32_t) fz->elem_count){
+    pos = fz->remap[pos - fz->elem_count];
+  }
+  rhentry_t *slot = &fz->slots[pos];
+  return slot->hash == (uint32_t) hash && slot->elem_len == len &&
+    memcmp(fz->keys.bytes + slot->elem_off, elem, len) == 0;
+}
+
+// De-allocates the seeds, slots and string arena of `fz` and leaves it
+// empty. Does NOT free `fz` itself.
+void frozenset_free_fields(frozenset_t *fz){
+  free(fz->seeds);
+  free(fz->remap);
+  free(fz->slots);
+  strarena_free(&fz->keys);
+  frozenset_init(fz);
+}
+
+// Outputs all elements of `fz` in the order they were added to the
+// hash set it was frozen from, in the same format as
+// hashset_write_elems_ordered(). The arena holds them in that order.
+void frozenset_write_elems_ordered(frozenset_t *fz, FILE *out){
+  size_t off = 0;
+  for(int i = 0; i < fz->elem_count; i++){
+    char *elem = fz->keys.bytes + off;
+    fprintf(out, "   %d %s\n", i+1, elem);
+    off += strlen(elem) + 1;
+  }
+}
+
+// Writes `fz` to `filename` in a binary format which frozenset_load()
+// reads back without rebuilding: the magic bytes "HSFROZEN", the
+// format version, the element, bucket and position counts and arena
+// length, then the seeds, the remap table, the slots and the arena as
+// they are in memory. The file is only meant to be read on machines
+// with the same byte order and type sizes.
+void frozenset_save(frozenset_t *fz, char *filename){
+  FILE *file = fopen(filename, "wb");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  uint32_t version = FROZENSET_FILE_VERSION;
+  uint64_t keys_len = fz->keys.len;
+  fwrite(frozenset_magic, 1, sizeof(frozenset_magic), file);
+  fwrite(&version, sizeof(version), 1, file);
+  fwrite(&fz->elem_count, sizeof(int), 1, file);
+  fwrite(&fz->bucket_count, sizeof(int), 1, file);
+  fwrite(&fz->position_count, sizeof(int), 1, file);
+  fwrite(&keys_len, sizeof(keys_len), 1, file);
+  fwrite(fz->seeds, sizeof(uint32_t), fz->bucket_count, file);
+  fwrite(fz->remap, sizeof(uint32_t), fz->position_count - fz->elem_count, file);
+  fwrite(fz->slots, sizeof(rhentry_t), fz->elem_count, file);
+  fwrite(fz->keys.bytes, 1, keys_len, file);
+  fclose(file);
+}
+
+// Loads a file written by frozenset_save() into `fz`, replacing its
+// contents. The counts in the header are checked against the length
+// of the file before anything is allocated, so a damaged header can't
+// ask for more memory than the file could fill. Prints an error and
+// returns 0, leaving `fz` unchanged, if the file cannot be opened, is
+// not a frozen set of this version, has the wrong length, refers
+// outside its slots or strings or can't be held in memory; otherwise
+// returns 1.
+int frozenset_load(frozenset_t *fz, char *filename){
+  FILE *file = fopen(filename, "rb");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  char magic[sizeof(frozenset_magic)];
+  uint32_t version;
+  uint64_t keys_len;
+  frozenset_t loaded;
+  frozenset_init(&loaded);
+  if(fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+     memcmp(magic, frozenset_magic, sizeof(magic)) != 0 ||
+     fread(&version, sizeof(version), 1, file) != 1 ||
+     version != FROZENSET_FILE_VERSION){
+    printf("ERROR: '%s' is not a frozen hash set file\n", filename);
+    fclose(file);
+    return 0;
+  }
+  int ok = fread(&loaded.elem_count, sizeof(int), 1, file) == 1 &&
+    fread(&loaded.bucket_count, sizeof(int), 1, file) == 1 &&
+    fread(&loaded.position_count, sizeof(int), 1, file) == 1 &&
+    fread(&keys_len, sizeof(keys_len), 1, file) == 1 &&
+    loaded.elem_count >= 0 && loaded.bucket_count > 0 &&
+    loaded.position_count > loaded.elem_count;
+  int spare = ok ? loaded.position_count - loaded.elem_count : 0;
+  struct stat st;
+  if(ok){                                       // the arrays and arena must make up the rest of the file
+    uint64_t rest = fstat(fileno(file), &st) == 0 && st.st_size >= ftell(file) ?
+      (uint64_t) (st.st_size - ftell(file)) : 0;
+    uint64_t arrays = sizeof(uint32_t) * ((uint64_t) loaded.bucket_count + spare) +
+      sizeof(rhentry_t) * (uint64_t) loaded.elem_count;  // all counts are ints so this can't wrap
+    ok = arrays <= rest && keys_len == rest - arrays;
+  }
+  if(ok){
+    loaded.seeds = malloc(sizeof(uint32_t) * loaded.bucket_count);
+    loaded.remap = malloc(sizeof(uint32_t) * (spare > 0 ? spare : 1));
+    loaded.slots = malloc(sizeof(rhentry_t) * (loaded.elem_count > 0 ? loaded.elem_count : 1));
+    loaded.keys.bytes = malloc(keys_len > 0 ? keys_len : 1);
+    loaded.keys.len = keys_len;
+    loaded.keys.cap = keys_len;
+    ok = loaded.seeds != NULL && loaded.remap != NULL && loaded.slots != NULL &&
+      loaded.keys.bytes != NULL &&
+      fread(loaded.seeds, sizeof(uint32_t), loaded.bucket_count, file) == (size_t) loaded.bucket_count &&
+      fread(loaded.remap, sizeof(uint32_t), spare, file) == (size_t) spare &&
+      fread(loaded.slots, sizeof(rhentry_t), loaded.elem_count, file) == (size_t) loaded.elem_count &&
+      fread(loaded.keys.bytes, 1, keys_len, file) == keys_len;
+  }
+  fclose(file);
+  for(int i = 0; ok && i < spare; i++){         // remapped positions must be slots
+    ok = loaded.remap[i] < (uint32_t) loaded.elem_count || loaded.elem_count == 0;
+  }
+  for(int i = 0; ok && i < loaded.elem_count; i++){ // slots must refer to strings in the arena
+    rhentry_t *slot = &loaded.slots[i];
+    ok = slot->elem_len >= 0 && slot->elem_off < keys_len &&
+      (uint64_t) slot->elem_len < keys_len - slot->elem_off &&
+      loaded.keys.bytes[slot->elem_off + slot->elem_len] == '\0';
+  }
+  if(!ok){
+    printf("ERROR: frozen hash set file '%s' is truncated or damaged\n", filename);
+    frozenset_free_fields(&loaded);
+    return 0;
+  }
+  frozenset_free_fields(fz);
+  *fz = loaded;
+  return 1;
+}
@@ -4,38 +4,442 @@
 #define HASHSET_H 1
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
 
-// Type for linked list nodes in hash set
-typedef struct hashnode {
-  char elem[64];                // string for the element in this node
-  struct hashnode *table_next;  // pointer to next node at table index of this node, NULL if last node
-  struct hashnode *order_next;  // pointer to next node in insert order, NULL if last element added
+// Type of a string arena: strings stored back to back in one growable
+// block, each '\0'-terminated, and referred to by their offset
+typedef struct {
+  char *bytes;                  // the stored strings
+  size_t len;                   // bytes of `bytes` in use
+  size_t cap;                   // bytes allocated for `bytes`
+} strarena_t;
+
+// Type for linked list nodes in hash set. Nodes live in the `nodes`
+// array of the hash set in the order they were added and link to each
+// other by their 32-bit index in it; index 0 is never used so it
+// stands for no node. Removed nodes stay in the array, marked by a
+// negative `elem_len`, until hashset_remove() compacts it.
+typedef struct {
+  size_t elem_off;              // offset of the element string in the `keys` arena of the hash set
+  int elem_len;                 // length of the element string, not counting the '\0', -1 once removed
+  int hash;                     // hash code of the element, cached so chains and resizes need not recompute it
+  uint32_t table_next;          // index of next node at table index of this node, 0 if last node
 } hashnode_t;
 
+// Type for a bucket whose chain grew to HASHSET_SORT_CHAIN nodes: its
+// nodes in an array sorted by hash code, then length, then bytes, so a
+// lookup is a binary search. The `table_next` chain of the bucket is
+// kept as well.
+typedef struct {
+  int count;                    // number of nodes in the bucket
+  int capacity;                 // allocated length of `nodes`
+  uint32_t nodes[];             // indices of the bucket's nodes in sorted order
+} hashsorted_t;
+
 // Type of hash table
 typedef struct {
   int elem_count;               // number of elements in the table
   int table_size;               // how big is the table array
-  hashnode_t **table;           // array of "buckets" which contain nodes
-  hashnode_t *order_first;      // pointer to the first element node that was added
-  hashnode_t *order_last;       // pointer to last element that node that was added
+  int hash_mode;                // HASHSET_HASH_PRIME, _POW2 or _KEYED, see hashset_init_mode()
+  uint64_t seed[2];             // key of siphash13() in HASHSET_HASH_KEYED mode, 0 in the others
+  double max_load;              // hashset_add() expands once elem_count/table_size exceeds this, 0 never expands
+  uint32_t *table;              // array of "buckets", each the index of the first node of its chain or 0
+  hashsorted_t **sorted;        // per bucket of table: its sorted array or NULL; NULL until a bucket is converted
+  uint32_t *old_table;          // table still being drained by an incremental resize, NULL if none is in progress
+  hashsorted_t **old_sorted;    // sorted arrays of old_table's buckets, NULL if it had none
+  int old_table_size;           // size of old_table
+  int rehash_index;             // next bucket of old_table to move into table
+  int rehash_step;              // old buckets moved per add/contains during a resize, 0 resizes all at once
+  hashnode_t *nodes;            // every node in the order it was added starting at nodes[1]
+  int node_count;               // nodes used in `nodes`: elem_count plus those removed but not compacted
+  int nodes_cap;                // allocated length of `nodes`
+  strarena_t keys;              // string arena holding every element
 } hashset_t;
 
+// Type for an element of a Robin Hood or SwissTable hash set; kept in
+// an array in insertion order
+typedef struct {
+  size_t elem_off;              // offset of the element string in the `keys` arena of the set
+  int elem_len;                 // length of the element string, not counting the '\0'
+  uint32_t hash;                // low 32 bits of hashcode64() of the element
+} rhentry_t;
+
+// Type for a slot in the table of a Robin Hood hash set
+typedef struct {
+  uint32_t hash;                // cached hash of the element in this slot, saves a trip to `entries`
+  uint32_t entry;               // 1 + index in `entries` of the element in this slot, 0 if empty
+} rhslot_t;
+
+// Type of a Robin Hood hash set: open addressing with linear probing
+// where an element being inserted takes the slot of any element that
+// sits closer to its home slot, keeping probe lengths short and even
+typedef struct {
+  int elem_count;               // number of elements in the set
+  int table_size;               // number of slots, a power of two
+  double max_load;              // expand once elem_count/table_size would exceed this
+  rhslot_t *slots;              // the open addressing table
+  rhentry_t *entries;           // elements in insertion order
+  int entries_cap;              // allocated length of `entries`
+  strarena_t keys;              // string arena holding every element
+} rhset_t;
+
+// Type of a SwissTable hash set: open addressing over groups of
+// SWSET_GROUP_SIZE slots with a control byte per slot so a whole group
+// can be checked for an element with one vector compare
+typedef struct {
+  int elem_count;               // number of elements in the set
+  int table_size;               // number of slots, a power of two and a multiple of SWSET_GROUP_SIZE
+  double max_load;              // expand once elem_count/table_size would exceed this
+  uint8_t *ctrl;                // per slot: top 7 bits of the element's hash or SWSET_CTRL_EMPTY
+  uint32_t *slots;              // per slot: index in `entries` of its element, valid when ctrl is not empty
+  rhentry_t *entries;           // elements in insertion order
+  int entries_cap;              // allocated length of `entries`
+  strarena_t keys;              // string arena holding every element
+} swset_t;
+
+#define CKSET_STASH_SIZE 4           // elements a cuckoo set may hold outside its tables before it grows
+
+// Type for an element of a cuckoo hash set; kept in an array in
+// insertion order
+typedef struct {
+  size_t elem_off;              // offset of the element string in the `keys` arena of the set
+  int elem_len;                 // length of the element string, not counting the '\0'
+  uint64_t hash[2];             // siphash13() of the element under each table's seed, picks its slot there
+} ckentry_t;
+
+// Type of a cuckoo hash set: two tables each giving an element one
+// possible slot, chosen by independently seeded hashes, plus a small
+// stash for elements that fit in neither. A lookup examines at most
+// two slots and the stash, which is almost always empty
+typedef struct {
+  int elem_count;               // number of elements in the set
+  int table_size;               // total slots in both tables, a power of two
+  double max_load;              // expand once elem_count/table_size would exceed this
+  uint64_t seed[2][2];          // siphash13() key of each table; replaced at random when placing fails
+  uint32_t *tables[2];          // table_size/2 slots each: 1 + index in `entries`, 0 if empty
+  uint32_t stash[CKSET_STASH_SIZE]; // 1 + index in `entries` of elements that fit in neither table
+  int stash_count;              // number of elements in `stash`
+  ckentry_t *entries;           // elements in insertion order
+  int entries_cap;              // allocated length of `entries`
+  strarena_t keys;              // string arena holding every element
+} ckset_t;
+
+// Type of a frozen hash set: a read-only copy of a hashset_t made by
+// hashset_freeze() in which a minimal perfect hash gives every element
+// its own slot, so a lookup examines exactly one
+typedef struct {
+  int elem_count;               // number of elements, also the number of slots
+  int bucket_count;             // number of buckets elements are grouped into by hash
+  int position_count;           // positions a seed can send an element to, a few more than the slots
+  uint32_t *seeds;              // per bucket: seed which together with an element's hash gives its position
+  uint32_t *remap;              // per position past the last slot: the slot its element was moved to
+  rhentry_t *slots;             // one element per slot
+  strarena_t keys;              // string arena holding every element, in insertion order
+} frozenset_t;
+
+// Type for a node of a locked hash set: a chained node allocated on
+// its own, with the element stored after it, so it never moves while
+// threads traverse it
+typedef struct mtnode {
+  struct mtnode *table_next;    // next node in the same bucket, NULL if last
+  struct mtnode *order_next;    // node added next, NULL if the last added
+  uint32_t hash;                // low 32 bits of hashcode64() of the element
+  int elem_len;                 // length of the element string, not counting the '\0'
+  char elem[];                  // the element string, '\0'-terminated
+} mtnode_t;
+
+// Type for one lock of a locked hash set, alone on its cache line so
+// threads taking neighbouring locks don't slow each other down
+typedef struct {
+  pthread_rwlock_t lock;
+} __attribute__((aligned(64))) mtstripe_t;
+
+// Type of a locked hash set: a chained hash set that many threads may
+// add to and look up in at once. Bucket i is guarded by lock
+// i & stripe_mask of `stripes`, read-locked by lookups and
+// write-locked by adds; an expand takes every lock. Appends to the
+// insertion order list are serialized by `order_lock`
+typedef struct {
+  int elem_count;               // number of elements in the set
+  int table_size;               // number of buckets, a power of two
+  double max_load;              // add expands once elem_count/table_size exceeds this, 0 never expands
+  mtnode_t **table;             // buckets, each the head of a chain of nodes
+  int stripe_mask;              // locks in use less 1: MTSET_STRIPES or table_size if smaller, less 1
+  mtstripe_t *stripes;          // MTSET_STRIPES locks, cache line aligned
+  pthread_mutex_t order_lock;   // held while appending to the insertion order
+  mtnode_t *order_first;        // first node added, NULL if empty
+  mtnode_t *order_last;         // last node added, NULL if empty
+} mtset_t;
+
+// Type for a node of an RCU hash set. Readers only ever read `hash`,
+// `elem_len` and `elem`, which don't change once the node is published
+typedef struct rcunode {
+  struct rcunode *order_next;   // node added next, NULL if the last added
+  struct rcunode *order_prev;   // node added before, NULL if the first added
+  uint32_t hash;                // low 32 bits of hashcode64() of the element
+  int elem_len;                 // length of the element string, not counting the '\0'
+  char elem[];                  // the element string, '\0'-terminated
+} rcunode_t;
+
+// Type for the table of an RCU hash set: open addressing slots holding
+// node pointers, NULL if empty or RCUSET_REMOVED if the node there was
+// removed. Replaced whole on expand rather than changed in place
+typedef struct {
+  int size;                     // number of slots, a power of two
+  rcunode_t *slots[];           // the slots
+} rcutable_t;
+
+// Type for the epoch a reader of an RCU hash set entered its critical
+// section in, 0 when outside one; alone on its cache line so readers
+// don't slow each other down
+typedef struct {
+  uint64_t epoch;
+} __attribute__((aligned(64))) rcureader_t;
+
+// Type for a table or node an RCU hash set no longer uses but readers
+// may still, freed once the global epoch is 2 past `epoch`
+typedef struct rcuretired {
+  void *ptr;                    // the table or node to free
+  uint64_t epoch;               // global epoch when it was retired
+  struct rcuretired *next;      // retired before this one
+} rcuretired_t;
+
+// Type of an RCU hash set: readers look up elements without taking
+// any lock, inside critical sections marked with an epoch, while a
+// writer at a time adds, removes and expands under `write_lock`. The
+// writer never changes what a reader may be looking at: it publishes
+// new nodes and tables with release stores and retires the ones it
+// replaces until every reader has left the epoch they were retired in
+typedef struct {
+  int elem_count;               // number of elements in the set
+  int used;                     // slots holding a node or RCUSET_REMOVED
+  double max_load;              // the writer expands once used/size would exceed this
+  rcutable_t *table;            // the current table, read by readers with an acquire load
+  pthread_mutex_t write_lock;   // held by the writer adding, removing or expanding
+  uint64_t epoch;               // global epoch, starts at 1
+  rcureader_t *readers;         // RCUSET_MAX_READERS reader epochs, cache line aligned
+  int reader_count;             // readers registered by rcuset_reader()
+  rcuretired_t *retired;        // tables and nodes waiting to be freed, newest first
+  rcunode_t *order_first;       // first node added, NULL if empty
+  rcunode_t *order_last;        // last node added, NULL if empty
+} rcuset_t;
+
+// Type for an entry of the bucket directory of a constant database
+// file: where the bucket's slots start and how many it has
+typedef struct {
+  uint64_t start;               // index in the slots of the file of the bucket's first slot
+  uint64_t len;                 // slots of the bucket, twice its elements, 0 if it has none
+} cdbdir_t;
+
+// Type for a slot of a constant database file
+typedef struct {
+  uint32_t hash;                // bits 8 to 39 of hashcode64() of the element in this slot
+  int32_t elem_len;             // length of the element string, -1 if the slot is empty
+  uint64_t elem_off;            // offset of the element string in the keys of the file
+} cdbslot_t;
+
+// Type of a constant database: a read-only hash set answering lookups
+// by probing a file written by hashset_save_cdb() where it is mapped
+// in memory. Opening one reads nothing but the header, so it is ready
+// at once whatever its size, and every process mapping the same file
+// shares its pages in the page cache.
+typedef struct {
+  char *map;                    // the mapped file, NULL if none is open
+  size_t map_len;               // bytes mapped
+  int elem_count;               // number of elements in the file
+  cdbdir_t *dir;                // CDBSET_BUCKETS buckets within `map`
+  cdbslot_t *slots;             // slots of all buckets within `map`
+  char *keys;                   // elements in insertion order, each '\0'-terminated, within `map`
+  uint64_t keys_len;            // bytes of `keys`
+} cdbset_t;
+
+// Type for the table of functions making up a hash set
+// implementation. Lets hashset_main and the benchmarks run the same
+// commands against each implementation; `set` points to a variable of
+// that implementation's own type which is `set_size` bytes.
+typedef struct {
+  char *name;                   // name used to choose the implementation
+  size_t set_size;              // sizeof the implementation's set type
+  void (*init)(void *set, int table_size);
+  int  (*add)(void *set, char elem[]);
+  int  (*contains)(void *set, char elem[]);
+  void (*expand)(void *set);
+  void (*set_max_load)(void *set, double max_load);
+  void (*free_fields)(void *set);
+  void (*write_elems_ordered)(void *set, FILE *out);
+  void (*show_structure)(void *set);
+  void (*save)(void *set, char *filename);
+  int  (*load)(void *set, char *filename);
+} hashset_ops_t;
+
 #define HASHSET_DEFAULT_TABLE_SIZE 5 // default size of table for main application
+#define HASHSET_HASH_PRIME 0         // hashcode() modulo table_size, prime sizes; the original mode
+#define HASHSET_HASH_POW2  1         // low bits of hashcode64(), power of two sizes
+#define HASHSET_HASH_KEYED 2         // low bits of siphash13() under a per-set seed, power of two sizes
+#define HASHSET_KEYS_MIN_BYTES 256   // initial size of a string arena
+#define HASHSET_MIN_NODES 64         // initial length of the node array
+#define HASHSET_SORT_CHAIN 16        // an add growing a chain to this length converts it to a sorted array
+#define HASHSET_SHRINK_DIV 4         // hashset_remove() shrinks the table below max_load/HASHSET_SHRINK_DIV
+#define HASHSET_BATCH 16             // keys hashset_contains_many()/hashset_add_many() keep in flight
+#define HASHSET_FILE_VERSION 1       // version of the hashset_save_binary() file format
+#define HASHSET_FILE_BLOCK 65536     // bytes of a binary hash set file checksummed at a time
+#define RHSET_DEFAULT_MAX_LOAD 0.875 // default load factor limit of a Robin Hood set
+#define RHSET_MAX_MAX_LOAD 0.95      // highest load factor limit a Robin Hood set accepts
+#define RHSET_MIN_ENTRIES 16         // initial length of the entries array of a Robin Hood set
+#define SWSET_GROUP_SIZE 16          // slots whose control bytes are checked at once, one SSE2 register
+#define SWSET_CTRL_EMPTY 0x80        // control byte of an empty slot, never a 7-bit hash
+#define SWSET_DEFAULT_MAX_LOAD 0.875 // default load factor limit of a SwissTable set
+#define SWSET_MAX_MAX_LOAD 0.95      // highest load factor limit a SwissTable set accepts
+#define CKSET_MIN_TABLE_SIZE 8       // fewest total slots of a cuckoo set
+#define CKSET_DEFAULT_MAX_LOAD 0.45  // default load factor limit of a cuckoo set
+#define CKSET_MAX_MAX_LOAD 0.5       // one slot per bucket cuckoo hashing fails past half full
+#define CKSET_MAX_KICKS 64           // evictions an insert tries before using the stash
+#define CKSET_MAX_RESEEDS 4          // new seeds a cuckoo set tries at one size before growing
+#define CKSET_MAX_GROWS 4            // doublings a cuckoo set tries beyond the size asked for before giving up
+#define FROZENSET_BUCKET_ELEMS 3     // average elements per bucket of a frozen set
+#define FROZENSET_SPARE_DIV 32       // a frozen set has elem_count/FROZENSET_SPARE_DIV extra positions
+#define FROZENSET_FILE_VERSION 1     // version of the frozenset_save() file format
+#define MTSET_STRIPES 256            // locks of a locked set, a power of two
+#define RCUSET_MAX_READERS 128       // reader threads an RCU set can register
+#define RCUSET_DEFAULT_MAX_LOAD 0.75 // default load factor limit of an RCU set
+#define RCUSET_MAX_MAX_LOAD 0.9      // highest load factor limit an RCU set accepts
+#define RCUSET_MIN_TABLE_SIZE 8      // fewest slots of an RCU set
+#define RCUSET_REMOVED ((rcunode_t *) 1) // slot whose node was removed, probes continue past it
+#define CDBSET_BUCKETS 256           // buckets in the directory of a constant database, a power of two
+#define CDBSET_FILE_VERSION 1        // version of the hashset_save_cdb() file format
 
 // functions defined in hashset_funcs.c
+size_t strarena_add(strarena_t *arena, char str[], int len);
+void  strarena_free(strarena_t *arena);
+int   hashset_read_elem(FILE *file, char **line, size_t *line_cap, char **elem);
 int   hashcode(char key[]);
+int   hashcode_n(char key[], int len);
+uint64_t hashcode64(char key[], int len);
+uint64_t siphash13(char key[], int len, uint64_t k0, uint64_t k1);
+void  hashset_random_seed(uint64_t seed[2]);
+int   hashset_read_header(FILE *file, int *size, int *count, uint64_t seed[2]);
 int   next_prime(int num);
+uint64_t next_prime64(uint64_t num);
 
 void  hashset_init(hashset_t *hs, int table_size);
+void  hashset_init_mode(hashset_t *hs, int table_size, int hash_mode);
+void  hashset_init_keyed(hashset_t *hs, int table_size, uint64_t seed0, uint64_t seed1);
 int   hashset_add(hashset_t *hs, char elem[]);
 int   hashset_contains(hashset_t *hs, char key[]);
+int   hashset_add_n(hashset_t *hs, char elem[], int len);
+int   hashset_contains_n(hashset_t *hs, char elem[], int len);
+int   hashset_remove(hashset_t *hs, char elem[]);
+int   hashset_contains_many(hashset_t *hs, char *elems[], int count, unsigned char found[]);
+int   hashset_add_many(hashset_t *hs, char *elems[], int count);
+int   hashset_probe_count(hashset_t *hs, char elem[]);
 void  hashset_expand(hashset_t *hs);
+void  hashset_set_max_load(hashset_t *hs, double max_load);
+void  hashset_reserve(hashset_t *hs, int elem_count);
+void  hashset_set_rehash_step(hashset_t *hs, int rehash_step);
+void  hashset_rehash_finish(hashset_t *hs);
 void  hashset_free_fields(hashset_t *hs);
 
 void  hashset_write_elems_ordered(hashset_t *hs, FILE *out);
 void  hashset_show_structure(hashset_t *hs);
 void  hashset_save(hashset_t *hs, char *filename);
 int   hashset_load(hashset_t *hs, char *filename);
+void  hashset_save_binary(hashset_t *hs, char *filename);
+int   hashset_load_binary(hashset_t *hs, char *filename);
+int   hashset_build(hashset_t *hs, char *filename, int nthreads);
+
+extern hashset_ops_t hashset_chained_ops;
+
+// functions defined in rhset_funcs.c
+void  rhset_init(rhset_t *rh, int table_size);
+int   rhset_add(rhset_t *rh, char elem[]);
+int   rhset_contains(rhset_t *rh, char elem[]);
+void  rhset_expand(rhset_t *rh);
+void  rhset_set_max_load(rhset_t *rh, double max_load);
+void  rhset_free_fields(rhset_t *rh);
+void  rhset_write_elems_ordered(rhset_t *rh, FILE *out);
+void  rhset_show_structure(rhset_t *rh);
+void  rhset_save(rhset_t *rh, char *filename);
+int   rhset_load(rhset_t *rh, char *filename);
+
+extern hashset_ops_t rhset_ops;
+
+// functions defined in swset_funcs.c
+void  swset_init(swset_t *sw, int table_size);
+int   swset_add(swset_t *sw, char elem[]);
+int   swset_contains(swset_t *sw, char elem[]);
+void  swset_expand(swset_t *sw);
+void  swset_set_max_load(swset_t *sw, double max_load);
+void  swset_free_fields(swset_t *sw);
+void  swset_write_elems_ordered(swset_t *sw, FILE *out);
+void  swset_show_structure(swset_t *sw);
+void  swset_save(swset_t *sw, char *filename);
+int   swset_load(swset_t *sw, char *filename);
+
+extern hashset_ops_t swset_ops;
+
+// functions defined in ckset_funcs.c
+void  ckset_init(ckset_t *ck, int table_size);
+int   ckset_add(ckset_t *ck, char elem[]);
+int   ckset_contains(ckset_t *ck, char elem[]);
+int   ckset_probe_count(ckset_t *ck, char elem[]);
+void  ckset_expand(ckset_t *ck);
+void  ckset_set_max_load(ckset_t *ck, double max_load);
+void  ckset_free_fields(ckset_t *ck);
+void  ckset_write_elems_ordered(ckset_t *ck, FILE *out);
+void  ckset_show_structure(ckset_t *ck);
+void  ckset_save(ckset_t *ck, char *filename);
+int   ckset_load(ckset_t *ck, char *filename);
+
+extern hashset_ops_t ckset_ops;
+
+// functions defined in frozenset_funcs.c
+void  frozenset_init(frozenset_t *fz);
+int   hashset_freeze(hashset_t *hs, frozenset_t *fz);
+int   frozenset_contains(frozenset_t *fz, char elem[]);
+void  frozenset_free_fields(frozenset_t *fz);
+void  frozenset_write_elems_ordered(frozenset_t *fz, FILE *out);
+void  frozenset_save(frozenset_t *fz, char *filename);
+int   frozenset_load(frozenset_t *fz, char *filename);
+
+// functions defined in mtset_funcs.c
+void  mtset_init(mtset_t *mt, int table_size);
+int   mtset_add(mtset_t *mt, char elem[]);
+int   mtset_contains(mtset_t *mt, char elem[]);
+void  mtset_expand(mtset_t *mt);
+void  mtset_set_max_load(mtset_t *mt, double max_load);
+void  mtset_free_fields(mtset_t *mt);
+void  mtset_write_elems_ordered(mtset_t *mt, FILE *out);
+void  mtset_show_structure(mtset_t *mt);
+void  mtset_save(mtset_t *mt, char *filename);
+int   mtset_load(mtset_t *mt, char *filename);
+
+extern hashset_ops_t mtset_ops;
+
+// functions defined in rcuset_funcs.c
+void  rcuset_init(rcuset_t *rs, int table_size);
+int   rcuset_reader(rcuset_t *rs);
+void  rcuset_read_lock(rcuset_t *rs, int reader);
+void  rcuset_read_unlock(rcuset_t *rs, int reader);
+int   rcuset_contains(rcuset_t *rs, char elem[]);
+int   rcuset_add(rcuset_t *rs, char elem[]);
+int   rcuset_remove(rcuset_t *rs, char elem[]);
+void  rcuset_expand(rcuset_t *rs);
+void  rcuset_set_max_load(rcuset_t *rs, double max_load);
+int   rcuset_retired_count(rcuset_t *rs);
+void  rcuset_free_fields(rcuset_t *rs);
+void  rcuset_write_elems_ordered(rcuset_t *rs, FILE *out);
+void  rcuset_show_structure(rcuset_t *rs);
+void  rcuset_save(rcuset_t *rs, char *filename);
+int   rcuset_load(rcuset_t *rs, char *filename);
+
+extern hashset_ops_t rcuset_ops;
+
+// functions defined in cdbset_funcs.c
+void  hashset_save_cdb(hashset_t *hs, char *filename);
+int   cdbset_open(cdbset_t *cdb, char *filename);
+int   cdbset_contains(cdbset_t *cdb, char elem[]);
+void  cdbset_close(cdbset_t *cdb);
 
 #endif
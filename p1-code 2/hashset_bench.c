@@ -0,0 +1,1447 @@
+// hashset_bench.c: timing harness for the functions in
+// hashset_funcs.c. Each benchmark is selected by name on the command
+// line and prints wall-clock timings so that changes to the hash set
+// can be compared before and after.
+//
+// usage: ./hashset_bench <benchmark> [count]
+//   add   : hashset_add() count distinct keys then hashset_free_fields()
+//   mem   : bytes used per element for count keys of 6 to 20 characters
+//   long  : hashset_contains() hits and misses on keys with a 64-char shared prefix
+//   expand: one hashset_expand() of a table holding count keys at load factor 8
+//   grow  : adds and lookups starting from the default table size with max_load 0.75
+//   latency: per-operation add/contains latency percentiles, all-at-once vs incremental resize
+//   modes : add/hit/miss in HASHSET_HASH_PRIME vs HASHSET_HASH_POW2 vs HASHSET_HASH_KEYED mode
+//   prime : next_prime() at count points spread over the int range, next_prime64() above it
+//   impls : add/hit/miss through each hash set implementation in hashset_ops_t form
+//   loads : hit/miss of each implementation at load factors 0.5 to 0.875 in a table of count slots
+//   probes: lookup probe counts and times, chained vs cuckoo, on random and colliding keys
+//   frozen: hashset_freeze() build time, size and hit/miss vs chained, frozen vs text load time
+//   collide: add/lookup latency percentiles on random and colliding keys, prime vs pow2 vs keyed mode
+//   ordered: hashset_write_elems_ordered() to /dev/null and hashset_save() of count keys
+//   churn : hashset_remove() plus hashset_add() rounds on count keys, then removing all of them
+//   batch : scalar hashset_add()/hashset_contains() loops vs hashset_add_many()/hashset_contains_many()
+//   ints  : add/hit/miss of count integer IDs in u32set and u64set vs as decimal strings in hashset_t
+//   threads: ops/sec from 1 to 2x cores threads at 90/10 and 50/50 lookups/adds, one mutex vs mtset_t
+//   build : hashset_build() of a count line key file on 1 to 2x cores threads vs getline() and hashset_add_n()
+//   rcu   : reader latency percentiles while a writer adds count keys, rcuset_t vs mtset_t
+//   snapshot: save and load time and file size of count keys, hashset_save() text vs hashset_save_binary()
+//   cdb   : constant database open time, cold and warm lookups vs hashset_load_binary() and the chained set
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "hashset.h"
+#include "intset.h"
+
+#define BENCH_DEFAULT_COUNT 1000000 // number of keys used when no count is given
+#define BENCH_KEY_SIZE 16           // bytes reserved for each generated key
+#define BENCH_COLLIDE_KEY_SIZE 32   // bytes for each key with a colliding hashcode(), room for 15 pairs
+#define BENCH_COLLIDE_COUNT 20000   // colliding keys used by the probes benchmark
+#define BENCH_RCU_PRESENT 1000     // keys in the set before the rcu benchmark's writer starts
+#define BENCH_RCU_SAMPLES 2000000  // latencies each reader of the rcu benchmark keeps
+#define BENCH_CDB_COLD 10000      // lookups timed after a constant database is dropped from the page cache
+#define BENCH_TMP_FILE "hashset_bench.tmp" // scratch file for save/load benchmarks, removed after
+
+// Returns the current time in seconds from a monotonic clock.
+static double now_sec(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fills a malloc()'d block with `count` distinct keys of the form
+// "k1b3f..." and returns it. Key `i` starts at offset
+// i*BENCH_KEY_SIZE. Keys are derived from a multiplicative scramble of
+// the index so that consecutive keys do not share long prefixes.
+static char *make_keys(int count){
+  char *keys = malloc((size_t) count * BENCH_KEY_SIZE);
+  for(int i=0; i<count; i++){
+    unsigned int x = (unsigned int) i * 2654435761u;
+    snprintf(keys + (size_t) i*BENCH_KEY_SIZE, BENCH_KEY_SIZE, "k%08x%d", x, i % 10);
+  }
+  return keys;
+}
+
+// Times adding `count` keys to a hash set sized to hold them with a
+// load factor near 1 and then the time to free the hash set.
+static void bench_add(int count){
+  char *keys = make_keys(count);
+  hashset_t hs;
+  hashset_init(&hs, next_prime(count));
+
+  double start = now_sec();
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  double add_time = now_sec() - start;
+
+  start = now_sec();
+  hashset_free_fields(&hs);
+  double free_time = now_sec() - start;
+
+  printf("add:  %d keys in %.4f sec (%.1f ns/add, %.2f M adds/sec)\n",
+         count, add_time, add_time*1e9/count, count/add_time/1e6);
+  printf("free: %.4f sec\n", free_time);
+  free(keys);
+}
+
+// Builds a set of `count` keys whose lengths cycle through 6 to 20
+// characters, like typical dictionary tokens, and reports the bytes
+// held by the table, the node arena and the string arena.
+static void bench_mem(int count){
+  hashset_t hs;
+  hashset_init(&hs, next_prime(count));
+  char key[32];
+  size_t key_bytes = 0;
+  for(int i=0; i<count; i++){
+    unsigned int x = (unsigned int) i * 2654435761u;
+    int len = 6 + i % 15;
+    snprintf(key, sizeof(key), "%08x%08x%08x", x, i, x ^ i);
+    key[len] = '\0';
+    key_bytes += len;
+    hashset_add(&hs, key);
+  }
+  size_t table_bytes = sizeof(uint32_t) * hs.table_size;
+  size_t node_bytes = sizeof(hashnode_t) * hs.nodes_cap;
+  size_t total = table_bytes + node_bytes + hs.keys.cap;
+  printf("mem:  %d elems, avg key %.1f bytes\n", hs.elem_count, (double) key_bytes / count);
+  printf("  table %zu, nodes %zu, keys %zu bytes\n", table_bytes, node_bytes, hs.keys.cap);
+  printf("  %.1f bytes/elem total, %.1f bytes/elem excluding table\n",
+         (double) total / count, (double) (node_bytes + hs.keys.cap) / count);
+  hashset_free_fields(&hs);
+}
+
+// Times count hits then count misses with hashset_contains() on keys
+// that share a 64-character prefix so that any string comparison
+// against a non-matching node scans the whole prefix. The table is
+// kept at load factor 4 so chains hold several nodes.
+static void bench_long(int count){
+  char prefix[65];
+  memset(prefix, 'p', 64);
+  prefix[64] = '\0';
+  char key[96];
+  hashset_t hs;
+  hashset_init(&hs, next_prime(count / 4 + 1));
+  for(int i=0; i<count; i++){
+    snprintf(key, sizeof(key), "%s%d", prefix, i);
+    hashset_add(&hs, key);
+  }
+
+  double start = now_sec();
+  int found = 0;
+  for(int i=0; i<count; i++){
+    snprintf(key, sizeof(key), "%s%d", prefix, i);
+    found += hashset_contains(&hs, key);
+  }
+  double hit_time = now_sec() - start;
+
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    snprintf(key, sizeof(key), "%s%d", prefix, count + i);
+    found += hashset_contains(&hs, key);
+  }
+  double miss_time = now_sec() - start;
+
+  printf("long: %d keys, %d found\n", count, found);
+  printf("  hit  %.1f ns/lookup\n", hit_time*1e9/count);
+  printf("  miss %.1f ns/lookup\n", miss_time*1e9/count);
+  hashset_free_fields(&hs);
+}
+
+// Times a single hashset_expand() of a set of `count` keys whose
+// table is small enough that the load factor is about 8.
+static void bench_expand(int count){
+  char *keys = make_keys(count);
+  hashset_t hs;
+  hashset_init(&hs, next_prime(count / 8 + 1));
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  int old_size = hs.table_size;
+
+  double start = now_sec();
+  hashset_expand(&hs);
+  double expand_time = now_sec() - start;
+
+  printf("expand: %d keys, table %d -> %d in %.4f sec (%.1f ns/elem)\n",
+         count, old_size, hs.table_size, expand_time, expand_time*1e9/count);
+  hashset_free_fields(&hs);
+  free(keys);
+}
+
+// Times adding `count` keys to a hash set that starts at the default
+// table size and grows automatically under a maximum load factor of
+// 0.75, then times looking every key up again.
+static void bench_grow(int count){
+  char *keys = make_keys(count);
+  hashset_t hs;
+  hashset_init(&hs, HASHSET_DEFAULT_TABLE_SIZE);
+  hashset_set_max_load(&hs, 0.75);
+
+  double start = now_sec();
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  double add_time = now_sec() - start;
+
+  start = now_sec();
+  int found = 0;
+  for(int i=0; i<count; i++){
+    found += hashset_contains(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  double contains_time = now_sec() - start;
+
+  printf("grow: %d keys, final table %d, load %.4f\n",
+         found, hs.table_size, (double) hs.elem_count / hs.table_size);
+  printf("  add      %.1f ns/op\n", add_time*1e9/count);
+  printf("  contains %.1f ns/op\n", contains_time*1e9/count);
+  hashset_free_fields(&hs);
+  free(keys);
+}
+
+// qsort() comparison for doubles in ascending order
+static int cmp_double(const void *a, const void *b){
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// Adds `count` keys to an auto-growing hash set with the given
+// `rehash_step`, looking up an earlier key after each add, timing
+// every operation individually and printing latency percentiles.
+static void latency_run(char *keys, int count, int rehash_step){
+  double *lat = malloc(sizeof(double) * 2 * count);
+  hashset_t hs;
+  hashset_init(&hs, HASHSET_DEFAULT_TABLE_SIZE);
+  hashset_set_max_load(&hs, 0.75);
+  hashset_set_rehash_step(&hs, rehash_step);
+  for(int i=0; i<count; i++){
+    double start = now_sec();
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+    double mid = now_sec();
+    hashset_contains(&hs, keys + (size_t) (i/2)*BENCH_KEY_SIZE);
+    double end = now_sec();
+    lat[2*i] = mid - start;
+    lat[2*i+1] = end - mid;
+  }
+  int n = 2 * count;
+  qsort(lat, n, sizeof(double), cmp_double);
+  printf("  rehash_step %4d: p50 %7.0f  p99 %7.0f  p999 %7.0f  max %10.0f ns\n",
+         rehash_step, lat[n/2]*1e9, lat[(int) (n*0.99)]*1e9,
+         lat[(int) (n*0.999)]*1e9, lat[n-1]*1e9);
+  hashset_free_fields(&hs);
+  free(lat);
+}
+
+// Compares per-operation latency of resizing all at once against
+// incremental resizing with a few different step sizes.
+static void bench_latency(int count){
+  char *keys = make_keys(count);
+  printf("latency: %d adds + %d contains, max_load 0.75\n", count, count);
+  int steps[] = {0, 1, 8, 64};
+  for(int i=0; i<4; i++){
+    latency_run(keys, count, steps[i]);
+  }
+  free(keys);
+}
+
+// Returns a malloc()'d random permutation of 0..count-1 produced by a
+// Fisher-Yates shuffle driven by a fixed-seed xorshift generator so
+// runs are repeatable.
+static int *make_perm(int count){
+  int *perm = malloc(sizeof(int) * count);
+  for(int i=0; i<count; i++){
+    perm[i] = i;
+  }
+  uint64_t x = 88172645463325252ULL;
+  for(int i=count-1; i>0; i--){
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    int j = x % (i+1);
+    int tmp = perm[i]; perm[i] = perm[j]; perm[j] = tmp;
+  }
+  return perm;
+}
+
+// Times adds, hits and misses of `count` keys in a hash set of the
+// given mode sized for a load factor of about 1. Keys are looked up in
+// a shuffled order so that consecutive lookups do not benefit from any
+// locality the generated keys happen to have under a given hash.
+static void modes_run(char *keys, int count, int hash_mode, char *name){
+  int *perm = make_perm(count);
+  hashset_t hs;
+  hashset_init_mode(&hs, hash_mode != HASHSET_HASH_PRIME ? count : next_prime(count), hash_mode);
+
+  double start = now_sec();
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  double add_time = now_sec() - start;
+
+  start = now_sec();
+  int found = 0;
+  for(int i=0; i<count; i++){
+    found += hashset_contains(&hs, keys + (size_t) perm[i]*BENCH_KEY_SIZE);
+  }
+  double hit_time = now_sec() - start;
+
+  char miss[BENCH_KEY_SIZE];
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    memcpy(miss, keys + (size_t) perm[i]*BENCH_KEY_SIZE, BENCH_KEY_SIZE);
+    miss[0] = 'm';                              // same shape as the keys but never added
+    found += hashset_contains(&hs, miss);
+  }
+  double miss_time = now_sec() - start;
+
+  printf("  %-6s table %8d: add %6.1f  hit %6.1f  miss %6.1f ns/op (%d found)\n",
+         name, hs.table_size, add_time*1e9/count, hit_time*1e9/count,
+         miss_time*1e9/count, found);
+  hashset_free_fields(&hs);
+  free(perm);
+}
+
+// Compares the original prime/hashcode() mode with the power of two
+// hashcode64() and siphash13() modes on the same keys.
+static void bench_modes(int count){
+  char *keys = make_keys(count);
+  printf("modes: %d keys\n", count);
+  modes_run(keys, count, HASHSET_HASH_PRIME, "prime");
+  modes_run(keys, count, HASHSET_HASH_POW2, "pow2");
+  modes_run(keys, count, HASHSET_HASH_KEYED, "keyed");
+  free(keys);
+}
+
+// Calls `count` times next_prime() on values evenly spaced over 0 to
+// INT_MAX (the last call is on INT_MAX itself) and then next_prime64()
+// on values spread up to 2^63, reporting average and worst call time.
+static void bench_prime(int count){
+  double total = 0, worst = 0;
+  long long checksum = 0;
+  for(int i=0; i<count; i++){
+    int num = (int) (2147483647.0 * i / (count > 1 ? count-1 : 1));
+    double start = now_sec();
+    checksum += next_prime(num);
+    double t = now_sec() - start;
+    total += t;
+    worst = t > worst ? t : worst;
+  }
+  printf("prime: next_prime() %d values in [0, INT_MAX]: avg %.1f ns, max %.1f ns\n",
+         count, total*1e9/count, worst*1e9);
+
+  total = worst = 0;
+  uint64_t x = 88172645463325252ULL;
+  for(int i=0; i<count; i++){
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    uint64_t num = x >> (1 + i % 32);             // magnitudes from 2^31 to 2^63
+    double start = now_sec();
+    checksum += next_prime64(num);
+    double t = now_sec() - start;
+    total += t;
+    worst = t > worst ? t : worst;
+  }
+  printf("       next_prime64() %d values up to 2^63: avg %.1f ns, max %.1f ns (checksum %lld)\n",
+         count, total*1e9/count, worst*1e9, checksum);
+}
+
+// hash set implementations compared by the impls benchmark
+static hashset_ops_t *impls[] = {
+  &hashset_chained_ops,
+  &rhset_ops,
+  &swset_ops,
+  NULL,
+};
+
+// Times adds, shuffled hits and shuffled misses of `count` keys
+// through the functions of `ops`. Each set starts with `count` buckets
+// or slots; implementations that grow do so under their default load
+// factor limit.
+static void impls_run(hashset_ops_t *ops, char *keys, int *perm, int count){
+  void *set = malloc(ops->set_size);
+  ops->init(set, count);
+
+  double start = now_sec();
+  for(int i=0; i<count; i++){
+    ops->add(set, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  double add_time = now_sec() - start;
+
+  start = now_sec();
+  int found = 0;
+  for(int i=0; i<count; i++){
+    found += ops->contains(set, keys + (size_t) perm[i]*BENCH_KEY_SIZE);
+  }
+  double hit_time = now_sec() - start;
+
+  char miss[BENCH_KEY_SIZE];
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    memcpy(miss, keys + (size_t) perm[i]*BENCH_KEY_SIZE, BENCH_KEY_SIZE);
+    miss[0] = 'm';
+    found += ops->contains(set, miss);
+  }
+  double miss_time = now_sec() - start;
+
+  printf("  %-8s add %6.1f  hit %6.1f  miss %6.1f ns/op, %.2f M lookups/sec (%d found)\n",
+         ops->name, add_time*1e9/count, hit_time*1e9/count, miss_time*1e9/count,
+         2*count/(hit_time+miss_time)/1e6, found);
+  ops->free_fields(set);
+  free(set);
+}
+
+// Runs the same workload through every implementation in impls[].
+static void bench_impls(int count){
+  char *keys = make_keys(count);
+  int *perm = make_perm(count);
+  printf("impls: %d keys\n", count);
+  for(int i=0; impls[i] != NULL; i++){
+    impls_run(impls[i], keys, perm, count);
+  }
+  free(perm);
+  free(keys);
+}
+
+// Times hits and misses in a set of implementation `ops` with
+// `table_size` slots filled to `load` with keys from `keys`. The load
+// factor limit is raised so that the table keeps its size.
+static void loads_run(hashset_ops_t *ops, char *keys, int *perm, int table_size, double load){
+  int count = load * table_size;
+  void *set = malloc(ops->set_size);
+  ops->init(set, table_size);
+  ops->set_max_load(set, 0.95);
+  for(int i=0; i<count; i++){
+    ops->add(set, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+
+  double start = now_sec();
+  int found = 0;
+  for(int i=0; i<count; i++){
+    found += ops->contains(set, keys + (size_t) perm[i]*BENCH_KEY_SIZE);
+  }
+  double hit_time = now_sec() - start;
+
+  char miss[BENCH_KEY_SIZE];
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    memcpy(miss, keys + (size_t) perm[i]*BENCH_KEY_SIZE, BENCH_KEY_SIZE);
+    miss[0] = 'm';
+    found += ops->contains(set, miss);
+  }
+  double miss_time = now_sec() - start;
+
+  printf("  %-8s load %.3f  hit %6.1f  miss %6.1f ns/op (%d found)\n",
+         ops->name, load, hit_time*1e9/count, miss_time*1e9/count, found);
+  ops->free_fields(set);
+  free(set);
+}
+
+// Runs lookups through every implementation in impls[] at rising load
+// factors of a table of `table_size` slots, rounded down to a power of
+// two so the open addressing sets are not resized.
+static void bench_loads(int table_size){
+  int size = 1;
+  while(size * 2 <= table_size){
+    size *= 2;
+  }
+  double loads[] = {0.5, 0.625, 0.75, 0.875};
+  int max_count = loads[3] * size;
+  char *keys = make_keys(max_count);
+  printf("loads: %d slots\n", size);
+  for(int l=0; l<4; l++){
+    int *perm = make_perm(loads[l] * size);
+    for(int i=0; impls[i] != NULL; i++){
+      loads_run(impls[i], keys, perm, size, loads[l]);
+    }
+    free(perm);
+  }
+  free(keys);
+}
+
+// Returns `count` malloc()'d keys of BENCH_COLLIDE_KEY_SIZE bytes
+// that all have the same hashcode(): each is a different string of
+// "Aa" and "BB" pairs, which hash alike. Adversarial input for the
+// chained set in its default HASHSET_HASH_PRIME mode.
+static char *make_colliding_keys(int count){
+  char *keys = malloc((size_t) count * BENCH_COLLIDE_KEY_SIZE);
+  int pairs = (BENCH_COLLIDE_KEY_SIZE - 1) / 2;
+  for(int i=0; i<count; i++){
+    char *key = keys + (size_t) i*BENCH_COLLIDE_KEY_SIZE;
+    for(int p=0; p<pairs; p++){
+      memcpy(key + 2*p, (i >> p) & 1 ? "BB" : "Aa", 2);
+    }
+    key[2*pairs] = '\0';
+  }
+  return keys;
+}
+
+// Looks up `count` keys of `keys`, `key_size` bytes apart, and an
+// absent variant of each in the chained hash set `hs` or, if it is
+// NULL, the cuckoo set `ck`. Prints the mean, p999 and maximum number
+// of places examined per lookup along with the time per lookup.
+static void probes_run(char *name, hashset_t *hs, ckset_t *ck, char *keys, int key_size, int count){
+  int n = 2 * count;
+  double *probes = malloc(sizeof(double) * n);
+  char miss[BENCH_COLLIDE_KEY_SIZE];
+  long total = 0;
+  for(int i=0; i<count; i++){
+    char *key = keys + (size_t) i*key_size;
+    memcpy(miss, key, key_size);
+    miss[1] = 'm';
+    probes[2*i] = hs ? hashset_probe_count(hs, key) : ckset_probe_count(ck, key);
+    probes[2*i+1] = hs ? hashset_probe_count(hs, miss) : ckset_probe_count(ck, miss);
+    total += probes[2*i] + probes[2*i+1];
+  }
+  qsort(probes, n, sizeof(double), cmp_double);
+
+  double start = now_sec();
+  int found = 0;
+  for(int i=0; i<count; i++){
+    char *key = keys + (size_t) i*key_size;
+    memcpy(miss, key, key_size);
+    miss[1] = 'm';
+    found += hs ? hashset_contains(hs, key) : ckset_contains(ck, key);
+    found += hs ? hashset_contains(hs, miss) : ckset_contains(ck, miss);
+  }
+  double time = now_sec() - start;
+
+  printf("  %-8s probes mean %6.2f  p999 %6.0f  max %6.0f  %8.1f ns/lookup (%d found)\n",
+         name, (double) total / n, probes[(int) (n*0.999)], probes[n-1], time*1e9/n, found);
+  free(probes);
+}
+
+// Compares the places a lookup examines in the chained set, sized for
+// a load factor of about 1, and the cuckoo set, grown from the
+// default size, for the `count` keys in `keys`.
+static void probes_keys(char *what, char *keys, int key_size, int count){
+  printf("probes: %d %s keys\n", count, what);
+  hashset_t hs;
+  hashset_init(&hs, next_prime(count));
+  ckset_t ck;
+  ckset_init(&ck, HASHSET_DEFAULT_TABLE_SIZE);
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*key_size);
+    ckset_add(&ck, keys + (size_t) i*key_size);
+  }
+  probes_run("chained", &hs, NULL, keys, key_size, count);
+  probes_run("cuckoo", NULL, &ck, keys, key_size, count);
+  hashset_free_fields(&hs);
+  ckset_free_fields(&ck);
+}
+
+// Probe counts for `count` ordinary keys, then for up to
+// BENCH_COLLIDE_COUNT keys with colliding hashcode()s.
+static void bench_probes(int count){
+  char *keys = make_keys(count);
+  probes_keys("random", keys, BENCH_KEY_SIZE, count);
+  free(keys);
+  int colliding = count < BENCH_COLLIDE_COUNT ? count : BENCH_COLLIDE_COUNT;
+  keys = make_colliding_keys(colliding);
+  probes_keys("colliding", keys, BENCH_COLLIDE_KEY_SIZE, colliding);
+  free(keys);
+}
+
+// Times `count` hits then `count` misses through `contains` on `set`,
+// looking keys up in the order of `perm`, and stores the ns per
+// lookup of each in `hit_ns` and `miss_ns`.
+static void time_lookups(int (*contains)(void *set, char elem[]), void *set,
+                         char *keys, int *perm, int count, double *hit_ns, double *miss_ns){
+  double start = now_sec();
+  int found = 0;
+  for(int i=0; i<count; i++){
+    found += contains(set, keys + (size_t) perm[i]*BENCH_KEY_SIZE);
+  }
+  *hit_ns = (now_sec() - start)*1e9/count;
+  char miss[BENCH_KEY_SIZE];
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    memcpy(miss, keys + (size_t) perm[i]*BENCH_KEY_SIZE, BENCH_KEY_SIZE);
+    miss[0] = 'm';
+    found += contains(set, miss);
+  }
+  *miss_ns = (now_sec() - start)*1e9/count;
+  if(found != count){
+    printf("  WARNING: %d of %d keys found\n", found, count);
+  }
+}
+
+static int chained_contains(void *set, char elem[]){ return hashset_contains(set, elem); }
+static int frozen_contains(void *set, char elem[]){ return frozenset_contains(set, elem); }
+
+// Builds a chained hash set of `count` keys, freezes it and compares
+// lookups in each, then compares loading the frozen set from its
+// binary file against loading the chained set from its text file.
+static void bench_frozen(int count){
+  char *keys = make_keys(count);
+  int *perm = make_perm(count);
+  hashset_t hs;
+  hashset_init(&hs, next_prime(count));
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  frozenset_t fz;
+  double start = now_sec();
+  hashset_freeze(&hs, &fz);
+  double freeze_time = now_sec() - start;
+  size_t bytes = sizeof(uint32_t) * (fz.bucket_count + fz.position_count - fz.elem_count) +
+    sizeof(rhentry_t) * fz.elem_count;
+  printf("frozen: %d keys, freeze %.3f s, %.2f bytes/key of seeds, remap and slots\n",
+         count, freeze_time, (double) bytes / count);
+
+  double hit_ns, miss_ns;
+  time_lookups(chained_contains, &hs, keys, perm, count, &hit_ns, &miss_ns);
+  printf("  chained  hit %6.1f  miss %6.1f ns/op\n", hit_ns, miss_ns);
+  time_lookups(frozen_contains, &fz, keys, perm, count, &hit_ns, &miss_ns);
+  printf("  frozen   hit %6.1f  miss %6.1f ns/op\n", hit_ns, miss_ns);
+
+  hashset_save(&hs, BENCH_TMP_FILE);
+  start = now_sec();
+  hashset_load(&hs, BENCH_TMP_FILE);
+  printf("  load chained from text  %.3f s\n", now_sec() - start);
+  frozenset_save(&fz, BENCH_TMP_FILE);
+  start = now_sec();
+  frozenset_load(&fz, BENCH_TMP_FILE);
+  printf("  load frozen from binary %.3f s\n", now_sec() - start);
+  remove(BENCH_TMP_FILE);
+
+  frozenset_free_fields(&fz);
+  hashset_free_fields(&hs);
+  free(perm);
+  free(keys);
+}
+
+// Adds the `count` keys of `keys`, `key_size` bytes apart, to a
+// chained set in `hash_mode` grown from the default size with
+// max_load 0.75, then looks up each key and an absent variant of it,
+// timing every operation. Prints latency percentiles of the adds and
+// of the lookups.
+static void collide_run(char *keys, int key_size, int count, int hash_mode, char *name){
+  double *add_lat = malloc(sizeof(double) * count);
+  double *find_lat = malloc(sizeof(double) * 2 * count);
+  hashset_t hs;
+  hashset_init_mode(&hs, HASHSET_DEFAULT_TABLE_SIZE, hash_mode);
+  hashset_set_max_load(&hs, 0.75);
+  for(int i=0; i<count; i++){
+    double start = now_sec();
+    hashset_add(&hs, keys + (size_t) i*key_size);
+    add_lat[i] = now_sec() - start;
+  }
+  char miss[BENCH_COLLIDE_KEY_SIZE];
+  int found = 0;
+  for(int i=0; i<count; i++){
+    char *key = keys + (size_t) i*key_size;
+    memcpy(miss, key, key_size);
+    miss[1] = 'm';
+    double start = now_sec();
+    found += hashset_contains(&hs, key);
+    double mid = now_sec();
+    found += hashset_contains(&hs, miss);
+    double end = now_sec();
+    find_lat[2*i] = mid - start;
+    find_lat[2*i+1] = end - mid;
+  }
+  qsort(add_lat, count, sizeof(double), cmp_double);
+  int n = 2 * count;
+  qsort(find_lat, n, sizeof(double), cmp_double);
+  printf("  %-6s add    p50 %7.0f  p99 %7.0f  p999 %7.0f  max %9.0f ns\n", name,
+         add_lat[count/2]*1e9, add_lat[(int) (count*0.99)]*1e9,
+         add_lat[(int) (count*0.999)]*1e9, add_lat[count-1]*1e9);
+  printf("  %-6s lookup p50 %7.0f  p99 %7.0f  p999 %7.0f  max %9.0f ns (%d found)\n", name,
+         find_lat[n/2]*1e9, find_lat[(int) (n*0.99)]*1e9,
+         find_lat[(int) (n*0.999)]*1e9, find_lat[n-1]*1e9, found);
+  hashset_free_fields(&hs);
+  free(find_lat);
+  free(add_lat);
+}
+
+// Latency of the chained set in each hash mode on `count` ordinary
+// keys, then on up to BENCH_COLLIDE_COUNT keys crafted to share a
+// hashcode(). Only the keyed mode is out of reach of crafted keys:
+// hashcode64() has no secret either, it just isn't the one attacked
+// here.
+static void bench_collide(int count){
+  char *keys = make_keys(count);
+  printf("collide: %d random keys\n", count);
+  collide_run(keys, BENCH_KEY_SIZE, count, HASHSET_HASH_PRIME, "prime");
+  collide_run(keys, BENCH_KEY_SIZE, count, HASHSET_HASH_POW2, "pow2");
+  collide_run(keys, BENCH_KEY_SIZE, count, HASHSET_HASH_KEYED, "keyed");
+  free(keys);
+  int colliding = count < BENCH_COLLIDE_COUNT ? count : BENCH_COLLIDE_COUNT;
+  keys = make_colliding_keys(colliding);
+  printf("collide: %d colliding keys\n", colliding);
+  collide_run(keys, BENCH_COLLIDE_KEY_SIZE, colliding, HASHSET_HASH_PRIME, "prime");
+  collide_run(keys, BENCH_COLLIDE_KEY_SIZE, colliding, HASHSET_HASH_POW2, "pow2");
+  collide_run(keys, BENCH_COLLIDE_KEY_SIZE, colliding, HASHSET_HASH_KEYED, "keyed");
+  free(keys);
+}
+
+// Times the walks over a chained set in insertion order: writing
+// every element with hashset_write_elems_ordered() to /dev/null, so
+// only the walk and formatting are timed, and hashset_save() to a
+// file.
+static void bench_ordered(int count){
+  char *keys = make_keys(count);
+  hashset_t hs;
+  hashset_init(&hs, next_prime(count));
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  FILE *null = fopen("/dev/null", "w");
+  double start = now_sec();
+  hashset_write_elems_ordered(&hs, null);
+  double write_time = now_sec() - start;
+  fclose(null);
+  start = now_sec();
+  hashset_save(&hs, BENCH_TMP_FILE);
+  double save_time = now_sec() - start;
+  remove(BENCH_TMP_FILE);
+  printf("ordered: %d keys, write_elems_ordered %.4f sec (%.1f ns/elem), save %.4f sec (%.1f ns/elem)\n",
+         count, write_time, write_time*1e9/count, save_time, save_time*1e9/count);
+  hashset_free_fields(&hs);
+  free(keys);
+}
+
+// Fills a chained set with max_load 0.75 with `count` keys then runs
+// `count` rounds that each remove the oldest key and add a new one,
+// so the set keeps its size while every key is replaced. Reports the
+// time per round and the nodes and string arena bytes held at the end,
+// which compaction keeps proportional to the elements present. Then
+// removes every key and reports the time per remove and the size the
+// table shrank to.
+static void bench_churn(int count){
+  char *keys = make_keys(2 * count);
+  hashset_t hs;
+  hashset_init(&hs, HASHSET_DEFAULT_TABLE_SIZE);
+  hashset_set_max_load(&hs, 0.75);
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  int full_size = hs.table_size;
+  double start = now_sec();
+  for(int i=0; i<count; i++){
+    hashset_remove(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+    hashset_add(&hs, keys + (size_t) (count + i)*BENCH_KEY_SIZE);
+  }
+  double churn_time = now_sec() - start;
+  printf("churn: %d keys, table %d, remove+add %.1f ns/round, after: %d nodes, %zu key bytes\n",
+         count, full_size, churn_time*1e9/count, hs.node_count, hs.keys.len);
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    hashset_remove(&hs, keys + (size_t) (count + i)*BENCH_KEY_SIZE);
+  }
+  double remove_time = now_sec() - start;
+  printf("  remove all %.1f ns/remove, table %d -> %d\n",
+         remove_time*1e9/count, full_size, hs.table_size);
+  hashset_free_fields(&hs);
+  free(keys);
+}
+
+// Times building a set of the first `count` keys and then looking up
+// `count` keys, half present and half absent in a shuffled order,
+// once with scalar loops and once with the batch functions. The table
+// is sized up front so neither build expands. Checks that both ways
+// find the same number of keys.
+static void batch_run(char *keys, char *misses, int count){
+  int *perm = make_perm(2 * count);
+  char **adds = malloc(sizeof(char *) * count);
+  char **queries = malloc(sizeof(char *) * count);
+  for(int i=0; i<count; i++){
+    adds[i] = keys + (size_t) i*BENCH_KEY_SIZE;
+    int q = perm[i];                              // one of 2*count: a hit below count, else a miss
+    queries[i] = q < count ? keys + (size_t) q*BENCH_KEY_SIZE
+                           : misses + (size_t) (q - count)*BENCH_KEY_SIZE;
+  }
+  unsigned char *found = malloc((count + 7) / 8);
+  hashset_t hs;
+
+  hashset_init(&hs, next_prime(count));
+  double start = now_sec();
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, adds[i]);
+  }
+  double add_time = now_sec() - start;
+  start = now_sec();
+  int scalar_found = 0;
+  for(int i=0; i<count; i++){
+    scalar_found += hashset_contains(&hs, queries[i]);
+  }
+  double contains_time = now_sec() - start;
+  hashset_free_fields(&hs);
+
+  hashset_init(&hs, next_prime(count));
+  start = now_sec();
+  hashset_add_many(&hs, adds, count);
+  double add_many_time = now_sec() - start;
+  start = now_sec();
+  int batch_found = hashset_contains_many(&hs, queries, count, found);
+  double contains_many_time = now_sec() - start;
+  size_t bytes = sizeof(uint32_t)*hs.table_size + sizeof(hashnode_t)*hs.nodes_cap + hs.keys.cap;
+  hashset_free_fields(&hs);
+
+  printf("  %8d keys (%4zu MB): add %6.1f  add_many %6.1f  contains %6.1f  contains_many %6.1f ns/key (%d found)\n",
+         count, bytes >> 20, add_time*1e9/count, add_many_time*1e9/count,
+         contains_time*1e9/count, contains_many_time*1e9/count, batch_found);
+  if(batch_found != scalar_found){
+    printf("  MISMATCH: contains found %d, contains_many found %d\n", scalar_found, batch_found);
+  }
+  free(found);
+  free(queries);
+  free(adds);
+  free(perm);
+}
+
+// Compares scalar loops with the batch functions at 1/64, 1/8 and all
+// of `count` keys so that the table goes from fitting in the cache to,
+// for a large enough count, far exceeding it.
+static void bench_batch(int count){
+  char *keys = make_keys(count);
+  char *misses = make_keys(count);
+  for(int i=0; i<count; i++){
+    misses[(size_t) i*BENCH_KEY_SIZE] = 'm';      // same shape as the keys but never added
+  }
+  printf("batch: scalar loops vs batches of %d\n", HASHSET_BATCH);
+  for(int div = 64; div >= 1; div /= 8){
+    batch_run(keys, misses, count / div);
+  }
+  free(misses);
+  free(keys);
+}
+
+// Returns the 32-bit ID number `i` used by the ints benchmark: a
+// multiplicative scramble, distinct for every `i` below 2^32, so IDs
+// are spread out the way real identifiers tend to be.
+static uint32_t bench_id(int i){
+  return (uint32_t) i * 2654435761u;
+}
+
+// Prints the add, hit and miss times per key of one set in the ints
+// benchmark along with the keys it found, which should be `count`.
+static void ints_report(char *name, int count, double add_time, double hit_time,
+                        double miss_time, int found, size_t bytes){
+  printf("  %-7s add %6.1f  hit %6.1f  miss %6.1f ns/op  %5.1f bytes/key (%d found)\n",
+         name, add_time*1e9/count, hit_time*1e9/count, miss_time*1e9/count,
+         (double) bytes / count, found);
+}
+
+// Stores the same `count` IDs as integers in a u32set and a u64set and
+// as their decimal strings in a HASHSET_HASH_POW2 hashset_t, starting
+// each from the default size with a max load of 0.75, then looks up
+// every ID in a shuffled order and as many that were never added. The
+// strings are formatted before timing starts, so the comparison leaves
+// out what formatting would cost callers. Finally saves the u64set and
+// checks the file loads into a hashset_t and back into a u64set.
+static void bench_ints(int count){
+  int *perm = make_perm(count);
+  char *strs = malloc((size_t) 2 * count * BENCH_KEY_SIZE);
+  for(int i=0; i<2*count; i++){
+    snprintf(strs + (size_t) i*BENCH_KEY_SIZE, BENCH_KEY_SIZE, "%u", bench_id(i));
+  }
+  printf("ints: %d IDs\n", count);
+
+  hashset_t hs;
+  hashset_init_mode(&hs, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_POW2);
+  hashset_set_max_load(&hs, 0.75);
+  double start = now_sec();
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, strs + (size_t) i*BENCH_KEY_SIZE);
+  }
+  double add_time = now_sec() - start;
+  int found = 0;
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    found += hashset_contains(&hs, strs + (size_t) perm[i]*BENCH_KEY_SIZE);
+  }
+  double hit_time = now_sec() - start;
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    found += hashset_contains(&hs, strs + (size_t) (count + perm[i])*BENCH_KEY_SIZE);
+  }
+  double miss_time = now_sec() - start;
+  ints_report("string", count, add_time, hit_time, miss_time, found,
+              sizeof(uint32_t)*hs.table_size + sizeof(hashnode_t)*hs.nodes_cap + hs.keys.cap);
+  hashset_free_fields(&hs);
+
+  u32set_t s32;
+  u32set_init(&s32, HASHSET_DEFAULT_TABLE_SIZE);
+  u32set_set_max_load(&s32, 0.75);
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    u32set_add(&s32, bench_id(i));
+  }
+  add_time = now_sec() - start;
+  found = 0;
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    found += u32set_contains(&s32, bench_id(perm[i]));
+  }
+  hit_time = now_sec() - start;
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    found += u32set_contains(&s32, bench_id(count + perm[i]));
+  }
+  miss_time = now_sec() - start;
+  ints_report("u32set", count, add_time, hit_time, miss_time, found,
+              sizeof(u32set_slot_t)*s32.table_size + sizeof(uint32_t)*s32.keys_cap);
+  u32set_free_fields(&s32);
+
+  u64set_t s64;
+  u64set_init(&s64, HASHSET_DEFAULT_TABLE_SIZE);
+  u64set_set_max_load(&s64, 0.75);
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    u64set_add(&s64, bench_id(i));
+  }
+  add_time = now_sec() - start;
+  found = 0;
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    found += u64set_contains(&s64, bench_id(perm[i]));
+  }
+  hit_time = now_sec() - start;
+  start = now_sec();
+  for(int i=0; i<count; i++){
+    found += u64set_contains(&s64, bench_id(count + perm[i]));
+  }
+  miss_time = now_sec() - start;
+  ints_report("u64set", count, add_time, hit_time, miss_time, found,
+              sizeof(u64set_slot_t)*s64.table_size + sizeof(uint64_t)*s64.keys_cap);
+
+  u64set_save(&s64, BENCH_TMP_FILE);
+  hashset_init(&hs, HASHSET_DEFAULT_TABLE_SIZE);
+  hashset_load(&hs, BENCH_TMP_FILE);
+  u64set_load(&s64, BENCH_TMP_FILE);
+  int last = count - 1;
+  if(hs.elem_count != count || s64.elem_count != count || s64.keys[last] != bench_id(last) ||
+     !hashset_contains(&hs, strs + (size_t) last*BENCH_KEY_SIZE)){
+    printf("  MISMATCH: u64set file loaded %d strings and %d IDs\n", hs.elem_count, s64.elem_count);
+  }
+  remove(BENCH_TMP_FILE);
+  hashset_free_fields(&hs);
+  u64set_free_fields(&s64);
+  free(strs);
+  free(perm);
+}
+
+// Type for the work of one thread of the threads benchmark. Threads
+// share `set`, guarded by `mutex` when it is a hashset_t, and add the
+// keys numbered `add_next` on up, which no other thread adds.
+typedef struct {
+  void *set;                    // hashset_t or mtset_t shared by all threads
+  pthread_mutex_t *mutex;       // the one lock around a hashset_t, NULL for an mtset_t
+  char *keys;                   // keys from make_keys(), the first `present` already in the set
+  int present;                  // keys added before the threads start, looked up at random
+  int add_next;                 // number of the next key this thread adds
+  int ops;                      // lookups plus adds this thread does
+  int write_pct;                // percent of ops that are adds
+  uint64_t rng;                 // xorshift state, different per thread
+  int found;                    // lookups that found their key, which should be all of them
+} threads_work_t;
+
+// Runs the lookups and adds of one thread of the threads benchmark.
+static void *threads_worker(void *arg){
+  threads_work_t *w = arg;
+  for(int i=0; i<w->ops; i++){
+    w->rng ^= w->rng << 13; w->rng ^= w->rng >> 7; w->rng ^= w->rng << 17;
+    if((int) (w->rng % 100) < w->write_pct){
+      char *key = w->keys + (size_t) w->add_next++ * BENCH_KEY_SIZE;
+      if(w->mutex != NULL){
+        pthread_mutex_lock(w->mutex);
+        hashset_add(w->set, key);
+        pthread_mutex_unlock(w->mutex);
+      }else{
+        mtset_add(w->set, key);
+      }
+    }else{
+      char *key = w->keys + (size_t) ((w->rng >> 32) % w->present) * BENCH_KEY_SIZE;
+      if(w->mutex != NULL){
+        pthread_mutex_lock(w->mutex);
+        w->found += hashset_contains(w->set, key);
+        pthread_mutex_unlock(w->mutex);
+      }else{
+        w->found += mtset_contains(w->set, key);
+      }
+    }
+  }
+  return NULL;
+}
+
+// Fills a set with `count` keys, a hashset_t in HASHSET_HASH_POW2 mode
+// behind one mutex if `locked` is 0 or else an mtset_t, both with a
+// max_load of 1, then times `nthreads` threads sharing `count` ops
+// between them of which `write_pct` percent add new keys and the rest
+// look up present ones. Returns millions of ops per second.
+static double threads_run(char *keys, int count, int nthreads, int write_pct, int locked){
+  hashset_t hs;
+  mtset_t mt;
+  pthread_mutex_t mutex;
+  void *set;
+  if(locked){
+    mtset_init(&mt, HASHSET_DEFAULT_TABLE_SIZE);
+    mtset_set_max_load(&mt, 1.0);
+    for(int i=0; i<count; i++){
+      mtset_add(&mt, keys + (size_t) i*BENCH_KEY_SIZE);
+    }
+    set = &mt;
+  }else{
+    hashset_init_mode(&hs, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_POW2);
+    hashset_set_max_load(&hs, 1.0);
+    for(int i=0; i<count; i++){
+      hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+    }
+    pthread_mutex_init(&mutex, NULL);
+    set = &hs;
+  }
+  threads_work_t work[nthreads];
+  pthread_t threads[nthreads];
+  int ops = count / nthreads;
+  for(int t=0; t<nthreads; t++){
+    work[t] = (threads_work_t) {set, locked ? NULL : &mutex, keys, count,
+                                count + t*ops, ops, write_pct, 88172645463325252ULL + t, 0};
+  }
+  double start = now_sec();
+  for(int t=0; t<nthreads; t++){
+    pthread_create(&threads[t], NULL, threads_worker, &work[t]);
+  }
+  int lookups = 0, found = 0;
+  for(int t=0; t<nthreads; t++){
+    pthread_join(threads[t], NULL);
+    lookups += work[t].ops - (work[t].add_next - (count + t*ops));
+    found += work[t].found;
+  }
+  double time = now_sec() - start;
+  if(found != lookups){
+    printf("  MISMATCH: %d of %d lookups found their key\n", found, lookups);
+  }
+  if(locked){
+    mtset_free_fields(&mt);
+  }else{
+    hashset_free_fields(&hs);
+    pthread_mutex_destroy(&mutex);
+  }
+  return (double) ops * nthreads / time / 1e6;
+}
+
+// Compares one mutex around a hashset_t with an mtset_t as the number
+// of threads sharing them doubles from 1 to twice the number of cores
+// (at least 8), at 90/10 and 50/50 lookups/adds. Each run does `count`
+// ops in all on a set holding `count` keys.
+static void bench_threads(int count){
+  char *keys = make_keys(2 * count);
+  int cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = 2 * cores > 8 ? 2 * cores : 8;
+  printf("threads: %d keys, %d ops per run, %d cores, Mops/sec\n", count, count, cores);
+  int write_pcts[2] = {10, 50};
+  for(int w=0; w<2; w++){
+    printf("  %d/%d lookups/adds\n", 100 - write_pcts[w], write_pcts[w]);
+    for(int n=1; n<=max_threads; n*=2){
+      double mutex_rate = threads_run(keys, count, n, write_pcts[w], 0);
+      double locked_rate = threads_run(keys, count, n, write_pcts[w], 1);
+      printf("    %3d threads: mutex %6.2f  locked %6.2f\n", n, mutex_rate, locked_rate);
+    }
+  }
+  free(keys);
+}
+
+// Writes `count` lines of keys, a quarter of them repeats of earlier
+// ones, to BENCH_TMP_FILE. Then times building a HASHSET_HASH_POW2
+// set with max_load 0.75 from it by reading it line by line with
+// getline() and calling hashset_add_n(), as hashset_load() does, and
+// with hashset_build() on 1 thread doubling up to twice the number of
+// cores (at least 8). Checks each build holds the same elements.
+static void bench_build(int count){
+  char *keys = make_keys(count);
+  FILE *file = fopen(BENCH_TMP_FILE, "w");
+  uint64_t x = 88172645463325252ULL;
+  for(int i=0; i<count; i++){
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    int k = i % 4 == 3 ? (int) (x % (i+1)) : i;   // every fourth line repeats an earlier key
+    fprintf(file, "%s\n", keys + (size_t) k*BENCH_KEY_SIZE);
+  }
+  fclose(file);
+  int cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = 2 * cores > 8 ? 2 * cores : 8;
+  printf("build: %d lines, %d cores\n", count, cores);
+
+  hashset_t seq;
+  hashset_init_mode(&seq, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_POW2);
+  hashset_set_max_load(&seq, 0.75);
+  double start = now_sec();
+  file = fopen(BENCH_TMP_FILE, "r");
+  char *line = NULL;
+  size_t line_cap = 0;
+  int len;
+  while((len = getline(&line, &line_cap, file)) > 0){
+    hashset_add_n(&seq, line, len - 1);           // less the '\n'
+  }
+  fclose(file);
+  free(line);
+  double seq_time = now_sec() - start;
+  printf("  getline+add_n : %.3f s, %d elements\n", seq_time, seq.elem_count);
+
+  for(int n=1; n<=max_threads; n*=2){
+    hashset_t hs;
+    hashset_init_mode(&hs, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_POW2);
+    hashset_set_max_load(&hs, 0.75);
+    start = now_sec();
+    hashset_build(&hs, BENCH_TMP_FILE, n);
+    double build_time = now_sec() - start;
+    printf("  build %3d threads: %.3f s (%.2fx)\n", n, build_time, seq_time / build_time);
+    if(hs.elem_count != seq.elem_count || hs.table_size != seq.table_size ||
+       memcmp(hs.keys.bytes, seq.keys.bytes, seq.keys.len) != 0){
+      printf("  MISMATCH: build holds %d elements\n", hs.elem_count);
+    }
+    hashset_free_fields(&hs);
+  }
+  hashset_free_fields(&seq);
+  remove(BENCH_TMP_FILE);
+  free(keys);
+}
+
+// Type for one reader thread of the rcu benchmark
+typedef struct {
+  void *set;                    // rcuset_t or mtset_t shared with the writer
+  int rcu;                      // 1 if `set` is an rcuset_t
+  char *keys;                   // keys from make_keys(), the first BENCH_RCU_PRESENT always present
+  char *miss;                   // a key never added
+  int *done;                    // set by the writer once it is finished
+  double *lat;                  // BENCH_RCU_SAMPLES lookup latencies in seconds
+  int samples;                  // latencies stored in `lat`
+  int wrong;                    // lookups that got the wrong answer, which should be none
+} rcu_reader_t;
+
+// Runs lookups of one reader of the rcu benchmark until the writer is
+// done: alternately a key that is always present and one that never
+// is, each timed including entering and leaving the critical section
+// of an rcuset_t.
+static void *rcu_reader(void *arg){
+  rcu_reader_t *r = arg;
+  int reader = r->rcu ? rcuset_reader(r->set) : 0;
+  uint64_t x = 88172645463325252ULL + (uintptr_t) r;
+  for(int i=0; !__atomic_load_n(r->done, __ATOMIC_ACQUIRE); i++){
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    char *key = i % 2 == 0 ? r->keys + (size_t) (x % BENCH_RCU_PRESENT)*BENCH_KEY_SIZE : r->miss;
+    double start = now_sec();
+    int found;
+    if(r->rcu){
+      rcuset_read_lock(r->set, reader);
+      found = rcuset_contains(r->set, key);
+      rcuset_read_unlock(r->set, reader);
+    }else{
+      found = mtset_contains(r->set, key);
+    }
+    double time = now_sec() - start;
+    if(found != (i % 2 == 0)){
+      r->wrong++;
+    }
+    if(r->samples < BENCH_RCU_SAMPLES){
+      r->lat[r->samples++] = time;
+    }
+  }
+  return NULL;
+}
+
+// Starts `nreaders` reader threads looking up keys in a set holding
+// BENCH_RCU_PRESENT keys while this thread adds `count` more, starting
+// from the default size so the set expands over and over, and with
+// `removes` set also removes every other key it added. Then reports
+// the latency percentiles of all lookups together, the writer's time
+// and how many retired items were still waiting to be freed.
+static void rcu_run(char *keys, int count, int nreaders, int rcu, int removes){
+  rcuset_t rs;
+  mtset_t mt;
+  void *set = rcu ? (void *) &rs : (void *) &mt;
+  if(rcu){
+    rcuset_init(&rs, HASHSET_DEFAULT_TABLE_SIZE);
+  }else{
+    mtset_init(&mt, HASHSET_DEFAULT_TABLE_SIZE);
+    mtset_set_max_load(&mt, 0.75);
+  }
+  for(int i=0; i<BENCH_RCU_PRESENT; i++){
+    if(rcu){
+      rcuset_add(&rs, keys + (size_t) i*BENCH_KEY_SIZE);
+    }else{
+      mtset_add(&mt, keys + (size_t) i*BENCH_KEY_SIZE);
+    }
+  }
+  char miss[BENCH_KEY_SIZE] = "never-added";
+  int done = 0;
+  rcu_reader_t readers[nreaders];
+  pthread_t threads[nreaders];
+  for(int t=0; t<nreaders; t++){
+    readers[t] = (rcu_reader_t) {set, rcu, keys, miss, &done,
+                                 malloc(sizeof(double) * BENCH_RCU_SAMPLES), 0, 0};
+    pthread_create(&threads[t], NULL, rcu_reader, &readers[t]);
+  }
+  double start = now_sec();
+  for(int i=BENCH_RCU_PRESENT; i<BENCH_RCU_PRESENT+count; i++){
+    char *key = keys + (size_t) i*BENCH_KEY_SIZE;
+    if(rcu){
+      rcuset_add(&rs, key);
+      if(removes && i % 2 == 1){
+        rcuset_remove(&rs, keys + (size_t) (i-1)*BENCH_KEY_SIZE);
+      }
+    }else{
+      mtset_add(&mt, key);
+    }
+  }
+  double write_time = now_sec() - start;
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+  int n = 0, wrong = 0;
+  for(int t=0; t<nreaders; t++){
+    pthread_join(threads[t], NULL);
+    n += readers[t].samples;
+    wrong += readers[t].wrong;
+  }
+  double *lat = malloc(sizeof(double) * (n > 0 ? n : 1));
+  n = 0;
+  for(int t=0; t<nreaders; t++){
+    memcpy(lat + n, readers[t].lat, sizeof(double) * readers[t].samples);
+    n += readers[t].samples;
+    free(readers[t].lat);
+  }
+  qsort(lat, n, sizeof(double), cmp_double);
+  char *name = !rcu ? "locked" : removes ? "rcu+rm" : "rcu";
+  printf("    %-6s %2d readers: p50 %6.0f  p99 %7.0f  p999 %9.0f  max %10.0f ns, writer %.3f s",
+         name, nreaders, lat[n/2]*1e9, lat[(int) (n*0.99)]*1e9, lat[(int) (n*0.999)]*1e9,
+         lat[n-1]*1e9, write_time);
+  if(rcu){
+    printf(", %d retired", rcuset_retired_count(&rs));
+    rcuset_free_fields(&rs);
+  }else{
+    mtset_free_fields(&mt);
+  }
+  printf("\n");
+  if(wrong > 0){
+    printf("  MISMATCH: %d lookups got the wrong answer\n", wrong);
+  }
+  free(lat);
+}
+
+// Stress test of lookups running during adds and expands: compares
+// the reader latencies of an rcuset_t, whose readers take no lock,
+// with those of an mtset_t, whose readers wait out every expand, for
+// 1 reader doubling up to the number of cores (at least 4).
+static void bench_rcu(int count){
+  char *keys = make_keys(BENCH_RCU_PRESENT + count);
+  int cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_readers = cores > 4 ? cores : 4;
+  printf("rcu: writer adds %d keys from the default size, %d cores\n", count, cores);
+  for(int n=1; n<=max_readers; n*=2){
+    rcu_run(keys, count, n, 0, 0);
+    rcu_run(keys, count, n, 1, 0);
+    rcu_run(keys, count, n, 1, 1);
+  }
+  free(keys);
+}
+
+// Returns the size in bytes of the file `filename`.
+static long file_size(char *filename){
+  FILE *file = fopen(filename, "r");
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+// Saves a set of `count` keys with hashset_save() and
+// hashset_save_binary() and times loading each file back into a set
+// with max_load 0.75 with hashset_load() and hashset_load_binary().
+// Checks both loads give the elements of the original in order.
+static void bench_snapshot(int count){
+  char *keys = make_keys(count);
+  hashset_t hs;
+  hashset_init_mode(&hs, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_POW2);
+  hashset_set_max_load(&hs, 0.75);
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  printf("snapshot: %d keys\n", count);
+  char *names[] = {"text", "binary"};
+  for(int binary=0; binary<2; binary++){
+    double start = now_sec();
+    if(binary){
+      hashset_save_binary(&hs, BENCH_TMP_FILE);
+    }else{
+      hashset_save(&hs, BENCH_TMP_FILE);
+    }
+    double save_time = now_sec() - start;
+    long size = file_size(BENCH_TMP_FILE);
+    hashset_t loaded;
+    hashset_init_mode(&loaded, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_POW2);
+    hashset_set_max_load(&loaded, 0.75);
+    start = now_sec();
+    if(binary){
+      hashset_load_binary(&loaded, BENCH_TMP_FILE);
+    }else{
+      hashset_load(&loaded, BENCH_TMP_FILE);
+    }
+    double load_time = now_sec() - start;
+    printf("  %-6s save %.3f s  load %.3f s  %.1f MB\n", names[binary],
+           save_time, load_time, size / 1e6);
+    if(loaded.elem_count != hs.elem_count || loaded.table_size != hs.table_size ||
+       memcmp(loaded.keys.bytes, hs.keys.bytes, hs.keys.len) != 0){
+      printf("  MISMATCH: %s load holds %d elements\n", names[binary], loaded.elem_count);
+    }
+    hashset_free_fields(&loaded);
+  }
+  remove(BENCH_TMP_FILE);
+  hashset_free_fields(&hs);
+  free(keys);
+}
+
+// Writes `filename` to disk and drops its pages from the page cache,
+// so the next reads of it come from the disk.
+static void drop_cached(char *filename){
+  int fd = open(filename, O_RDONLY);
+  fdatasync(fd);                                 // dirty pages are not dropped
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+static int cdb_contains(void *set, char elem[]){ return cdbset_contains(set, elem); }
+
+// Writes a set of `count` keys as a constant database and compares
+// opening it with cdbset_open() against hashset_load_binary() of the
+// same set. Then prints latency percentiles of BENCH_CDB_COLD lookups
+// of random keys with the file dropped from the page cache, and times
+// hits and misses of all keys once its pages are cached next to the
+// same lookups in the chained set in memory.
+static void bench_cdb(int count){
+  char *keys = make_keys(count);
+  int *perm = make_perm(count);
+  hashset_t hs;
+  hashset_init_mode(&hs, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_POW2);
+  hashset_set_max_load(&hs, 0.75);
+  for(int i=0; i<count; i++){
+    hashset_add(&hs, keys + (size_t) i*BENCH_KEY_SIZE);
+  }
+  double start = now_sec();
+  hashset_save_cdb(&hs, BENCH_TMP_FILE);
+  double write_time = now_sec() - start;
+  printf("cdb: %d keys, write %.3f s, %.1f MB\n", count, write_time, file_size(BENCH_TMP_FILE) / 1e6);
+
+  drop_cached(BENCH_TMP_FILE);
+  cdbset_t cdb;
+  start = now_sec();
+  cdbset_open(&cdb, BENCH_TMP_FILE);
+  printf("  open cdb            %10.6f s\n", now_sec() - start);
+  int cold = count < BENCH_CDB_COLD ? count : BENCH_CDB_COLD;
+  double *lat = malloc(sizeof(double) * cold);
+  int found = 0;
+  for(int i=0; i<cold; i++){
+    start = now_sec();
+    found += cdbset_contains(&cdb, keys + (size_t) perm[i]*BENCH_KEY_SIZE);
+    lat[i] = now_sec() - start;
+  }
+  qsort(lat, cold, sizeof(double), cmp_double);
+  printf("  cold %d hits: p50 %7.0f  p99 %7.0f  max %9.0f ns (%d found)\n", cold,
+         lat[cold/2]*1e9, lat[(int) (cold*0.99)]*1e9, lat[cold-1]*1e9, found);
+  free(lat);
+
+  double hit_ns, miss_ns;
+  time_lookups(cdb_contains, &cdb, keys, perm, count, &hit_ns, &miss_ns);  // faults in the pages
+  time_lookups(cdb_contains, &cdb, keys, perm, count, &hit_ns, &miss_ns);
+  printf("  warm cdb      hit %6.1f  miss %6.1f ns/op\n", hit_ns, miss_ns);
+  time_lookups(chained_contains, &hs, keys, perm, count, &hit_ns, &miss_ns);
+  printf("  chained       hit %6.1f  miss %6.1f ns/op\n", hit_ns, miss_ns);
+  cdbset_close(&cdb);
+
+  hashset_save_binary(&hs, BENCH_TMP_FILE);
+  drop_cached(BENCH_TMP_FILE);
+  hashset_t loaded;
+  hashset_init(&loaded, HASHSET_DEFAULT_TABLE_SIZE);
+  start = now_sec();
+  hashset_load_binary(&loaded, BENCH_TMP_FILE);
+  printf("  load binary, cold   %10.6f s\n", now_sec() - start);
+  hashset_free_fields(&loaded);
+  remove(BENCH_TMP_FILE);
+  hashset_free_fields(&hs);
+  free(perm);
+  free(keys);
+}
+
+int main(int argc, char *argv[]){
+  if(argc < 2){
+    printf("usage: %s <benchmark> [count]\n", argv[0]);
+    printf("benchmarks: add mem long expand grow latency modes prime impls loads probes frozen collide ordered churn batch ints threads build rcu\n");
+    return 1;
+  }
+  int count = BENCH_DEFAULT_COUNT;
+  if(argc > 2){
+    count = atoi(argv[2]);
+  }
+
+  if(strcmp("add", argv[1]) == 0){
+    bench_add(count);
+  }
+  else if(strcmp("mem", argv[1]) == 0){
+    bench_mem(count);
+  }
+  else if(strcmp("long", argv[1]) == 0){
+    bench_long(count);
+  }
+  else if(strcmp("expand", argv[1]) == 0){
+    bench_expand(count);
+  }
+  else if(strcmp("grow", argv[1]) == 0){
+    bench_grow(count);
+  }
+  else if(strcmp("latency", argv[1]) == 0){
+    bench_latency(count);
+  }
+  else if(strcmp("modes", argv[1]) == 0){
+    bench_modes(count);
+  }
+  else if(strcmp("prime", argv[1]) == 0){
+    bench_prime(count);
+  }
+  else if(strcmp("impls", argv[1]) == 0){
+    bench_impls(count);
+  }
+  else if(strcmp("loads", argv[1]) == 0){
+    bench_loads(count);
+  }
+  else if(strcmp("probes", argv[1]) == 0){
+    bench_probes(count);
+  }
+  else if(strcmp("frozen", argv[1]) == 0){
+    bench_frozen(count);
+  }
+  else if(strcmp("collide", argv[1]) == 0){
+    bench_collide(count);
+  }
+  else if(strcmp("ordered", argv[1]) == 0){
+    bench_ordered(count);
+  }
+  else if(strcmp("churn", argv[1]) == 0){
+    bench_churn(count);
+  }
+  else if(strcmp("batch", argv[1]) == 0){
+    bench_batch(count);
+  }
+  else if(strcmp("ints", argv[1]) == 0){
+    bench_ints(count);
+  }
+  else if(strcmp("threads", argv[1]) == 0){
+    bench_threads(count);
+  }
+  else if(strcmp("build", argv[1]) == 0){
+    bench_build(count);
+  }
+  else if(strcmp("rcu", argv[1]) == 0){
+    bench_rcu(count);
+  }
+  else if(strcmp("snapshot", argv[1]) == 0){
+    bench_snapshot(count);
+  }
+  else if(strcmp("cdb", argv[1]) == 0){
+    bench_cdb(count);
+  }
+  else{
+    printf("unknown benchmark %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
@@ -5,135 +5,874 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "hashset.h"
 
 // PROVIDED: Compute a simple hash code for the given character
-// string. The code is "computed" by casting the first 8 characters of
-// the string to a numbers and returning their xor. The empty string
-// has hash code 0. Longer strings will have numbers which are the
-// integer interpretation of up to their first 8 bytes.  ADVANTAGE:
-// constant time to compute the hash code. DISADVANTAGE: poor
-// distribution for long strings; all strings with same first 8 chars
-// hash to the same location.
+// string. The code is the polynomial hc*31 + c over the characters of
+// the string. The empty string has hash code 0. ADVANTAGE: simple and
+// matches the hash codes shown in saved structure output.
+// DISADVANTAGE: weakly mixed; strings differing only near the end tend
+// to land in nearby buckets.
+//
+// The arithmetic is done unsigned so that overflow wraps around
+// rather than being undefined; the result is the same as the
+// historical signed computation so saved hash codes are unchanged.
 int hashcode(char key[]){
-  int hc = 0;
+  unsigned int hc = 0;
   for(int i=0; key[i]!='\0'; i++){
     hc = hc*31 + key[i];
   }
-  return hc;
+  return (int) hc;
+}
+
+// Same as hashcode() on the first `len` characters of `key`, which
+// need not be followed by a '\0', so a key can be hashed where it sits
+// in a larger buffer.
+int hashcode_n(char key[], int len){
+  unsigned int hc = 0;
+  for(int i=0; i<len; i++){
+    hc = hc*31 + key[i];
+  }
+  return (int) hc;
+}
+
+// Multiplies `a` and `b` to a 128-bit product and folds its high half
+// into its low half; the core mixing step of hashcode64().
+static uint64_t hash_mum(uint64_t a, uint64_t b){
+  __uint128_t r = (__uint128_t) a * b;
+  return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+// Unaligned-safe little-endian loads of 8 and 4 bytes; fixed size
+// memcpy() compiles to a single load.
+static uint64_t hash_read8(const unsigned char *p){
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+static uint64_t hash_read4(const unsigned char *p){
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+#define HASH64_P0 0xa0761d6478bd642fULL // wyhash mixing constants
+#define HASH64_P1 0xe7037ed1a0b428dbULL
+#define HASH64_P2 0x8ebc6af09c88c6e3ULL
+
+// Compute a well-mixed 64-bit hash code for the `len` bytes at `key`
+// following the structure of wyhash. Keys of up to 16 bytes are read
+// with at most four overlapping loads and no loop; longer keys are
+// consumed 16 bytes per 128-bit multiply. Unlike hashcode() every byte
+// of the key affects every bit of the result, so the low bits alone
+// make a good table index. Used by hash sets in HASHSET_HASH_POW2
+// mode.
+uint64_t hashcode64(char key[], int len){
+  const unsigned char *p = (const unsigned char *) key;
+  uint64_t seed = HASH64_P0 ^ (uint64_t) len;
+  uint64_t a, b;
+  if(len <= 16){
+    if(len >= 4){                               // two pairs of overlapping 4 byte loads
+      int mid = (len >> 3) << 2;
+      a = (hash_read4(p) << 32) | hash_read4(p + mid);
+      b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - mid);
+    }
+    else if(len > 0){
+      a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    }
+    else{
+      a = b = 0;
+    }
+  }
+  else{
+    int i = len;
+    while(i > 16){
+      seed = hash_mum(hash_read8(p) ^ HASH64_P1, hash_read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = hash_read8(p + i - 16);                 // last 16 bytes, overlapping the loop if needed
+    b = hash_read8(p + i - 8);
+  }
+  return hash_mum(HASH64_P1 ^ (uint64_t) len, hash_mum(a ^ HASH64_P1, b ^ seed ^ HASH64_P2));
+}
+
+#define SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+// One SipRound mixing the four state words.
+#define SIP_ROUND(v0, v1, v2, v3) do{                                  \
+    v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+    v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;                        \
+    v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;                        \
+    v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+  }while(0)
+
+// Compute SipHash-1-3 of the `len` bytes at `key` under the 128-bit
+// key `k0`,`k1`: one round per 8 byte block and three to finish. This
+// is a keyed hash; without the key, inputs that collide can't be
+// found any faster than by trying them, so a set hashing with a
+// secret random key can't be flooded with keys crafted to share a
+// bucket. Costs a few ns per key more than hashcode64(). Used by hash
+// sets in HASHSET_HASH_KEYED mode.
+uint64_t siphash13(char key[], int len, uint64_t k0, uint64_t k1){
+  const unsigned char *p = (const unsigned char *) key;
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+  const unsigned char *end = p + (len & ~7);
+  for(; p != end; p += 8){
+    uint64_t m = hash_read8(p);
+    v3 ^= m;
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+  uint64_t b = (uint64_t) len << 56;            // last 0-7 bytes and the length
+  for(int i = 0; i < (len & 7); i++){
+    b |= (uint64_t) p[i] << (8 * i);
+  }
+  v3 ^= b;
+  SIP_ROUND(v0, v1, v2, v3);
+  v0 ^= b;
+  v2 ^= 0xff;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Fills `seed` with 128 random bits for a HASHSET_HASH_KEYED set,
+// read from /dev/urandom. Should that be unavailable, falls back to
+// mixing the clock and the address of `seed`, which is far weaker but
+// still differs from run to run.
+void hashset_random_seed(uint64_t seed[2]){
+  FILE *file = fopen("/dev/urandom", "r");
+  if(file != NULL){
+    int got = fread(seed, sizeof(uint64_t), 2, file);
+    fclose(file);
+    if(got == 2){
+      return;
+    }
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t x = (uint64_t) ts.tv_sec * 1000000007ULL ^ (uint64_t) ts.tv_nsec ^ (uintptr_t) seed;
+  for(int i = 0; i < 2; i++){                   // splitmix64 steps
+    x += 0x9e3779b97f4a7c15ULL;
+    uint64_t z = x;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    seed[i] = z ^ (z >> 31);
+  }
 }
 
 // Initialize the hash set 'hs' to have given size and elem_count
 // 0. Ensures that the 'table' field is initialized to an array of
-// size 'table_size' and is filled with NULLs. Also ensures that the
-// first/last pointers are initialized to NULL
+// size 'table_size' and is filled with 0s, empty buckets. Also ensures
+// that there are no nodes yet. Automatic expansion is
+// off until a maximum load factor is set with hashset_set_max_load().
+// Uses HASHSET_HASH_PRIME mode: hashcode() and prime table sizes.
 void hashset_init(hashset_t *hs, int table_size){ 
+  hashset_init_mode(hs, table_size, HASHSET_HASH_PRIME);
+}
+
+// Does the work of hashset_init_mode() using `seed` for the keyed
+// hash, which is zero in the modes that don't use it.
+static void hashset_init_seeded(hashset_t *hs, int table_size, int hash_mode, uint64_t seed[2]){
+  if(hash_mode != HASHSET_HASH_PRIME){
+    int pow2 = 1;
+    while(pow2 < table_size){
+      pow2 *= 2;
+    }
+    table_size = pow2;
+  }
   hs->elem_count = 0;
   hs->table_size = table_size;
-  hs->order_first = NULL; // first
-  hs->order_last = NULL; // last pointers to NULL
-  hs->table = malloc(sizeof(hashnode_t*) * table_size); // allocates table
+  hs->hash_mode = hash_mode;
+  hs->seed[0] = seed[0];
+  hs->seed[1] = seed[1];
+  hs->max_load = 0.0;    // never expand automatically
+  hs->sorted = NULL;     // no bucket converted to a sorted array
+  hs->old_table = NULL;  // no resize in progress
+  hs->old_sorted = NULL;
+  hs->old_table_size = 0;
+  hs->rehash_index = 0;
+  hs->rehash_step = 0;   // resizes move every node at once
+  hs->nodes = NULL;      // no nodes allocated yet
+  hs->node_count = 0;
+  hs->nodes_cap = 0;
+  hs->keys.bytes = NULL; // no element strings stored yet
+  hs->keys.len = 0;
+  hs->keys.cap = 0;
+  hs->table = malloc(sizeof(uint32_t) * table_size); // allocates table
+
+  for(int i= 0; i < table_size; i++){ // makes all buckets empty
+    hs->table[i] = 0;
+  }
+}
+
+// Initialize the hash set 'hs' as in hashset_init() using the given
+// `hash_mode`. In HASHSET_HASH_PRIME mode buckets are chosen by
+// hashcode() modulo a (usually prime) table size. In
+// HASHSET_HASH_POW2 mode buckets are chosen by masking the low bits
+// of hashcode64() so `table_size` is rounded up to a power of two and
+// expands double it; no division is needed per operation.
+// HASHSET_HASH_KEYED mode is like HASHSET_HASH_POW2 but hashes with
+// siphash13() under a random seed drawn for this set, see
+// hashset_init_keyed().
+void hashset_init_mode(hashset_t *hs, int table_size, int hash_mode){
+  uint64_t seed[2] = {0, 0};
+  if(hash_mode == HASHSET_HASH_KEYED){
+    hashset_random_seed(seed);
+  }
+  hashset_init_seeded(hs, table_size, hash_mode, seed);
+}
+
+// Initialize the hash set 'hs' in HASHSET_HASH_KEYED mode hashing with
+// the given seed rather than a random one. Elements that collide under
+// the fixed hashcode() or hashcode64() are spread out by a keyed hash,
+// and as long as the seed stays secret, keys can't be crafted to
+// collide under it. A set reloaded with the seed from its saved file
+// has the same structure as the one saved.
+void hashset_init_keyed(hashset_t *hs, int table_size, uint64_t seed0, uint64_t seed1){
+  uint64_t seed[2] = {seed0, seed1};
+  hashset_init_seeded(hs, table_size, HASHSET_HASH_KEYED, seed);
+}
+
+// Copies the `len` characters of `str` plus a terminating '\0' to the
+// end of `arena`, doubling the arena if it is too small, and returns
+// the offset the string was stored at. Pointers into the arena are
+// only valid until the next addition as growing may move it.
+size_t strarena_add(strarena_t *arena, char str[], int len){
+  size_t need = arena->len + len + 1;
+  if(need > arena->cap){
+    size_t cap = arena->cap == 0 ? HASHSET_KEYS_MIN_BYTES : arena->cap;
+    while(cap < need){
+      cap *= 2;
+    }
+    arena->bytes = realloc(arena->bytes, cap);
+    arena->cap = cap;
+  }
+  size_t off = arena->len;
+  memcpy(arena->bytes + off, str, len);
+  arena->bytes[off + len] = '\0';
+  arena->len = need;
+  return off;
+}
+
+// De-allocates the strings of `arena` and resets it to empty.
+void strarena_free(strarena_t *arena){
+  free(arena->bytes);
+  arena->bytes = NULL;
+  arena->len = 0;
+  arena->cap = 0;
+}
+
+// Returns the element string stored for node `n` in the string arena
+// of `hs`. The pointer is only valid until the next element is added
+// as adding may move the arena.
+static char *hashset_elem(hashset_t *hs, uint32_t n){
+  return hs->keys.bytes + hs->nodes[n].elem_off;
+}
+
+// Returns the index of the first node after node `n` in insertion
+// order that has not been removed, or 0 if there is none.
+static uint32_t hashset_next_present(hashset_t *hs, uint32_t n){
+  for(n++; n <= (uint32_t) hs->node_count; n++){
+    if(hs->nodes[n].elem_len >= 0){
+      return n;
+    }
+  }
+  return 0;
+}
+
+// Returns the hash code of the `len` character string `elem` that is
+// cached in nodes of `hs`: hashcode_n() in HASHSET_HASH_PRIME mode or the
+// low 32 bits of hashcode64() in HASHSET_HASH_POW2 mode or of
+// siphash13() under the seed of `hs` in HASHSET_HASH_KEYED mode. 32
+// bits are plenty to index any table as `table_size` is an int.
+static int hashset_hash(hashset_t *hs, char elem[], int len){
+  if(hs->hash_mode == HASHSET_HASH_POW2){
+    return (int) (uint32_t) hashcode64(elem, len);
+  }
+  if(hs->hash_mode == HASHSET_HASH_KEYED){
+    return (int) (uint32_t) siphash13(elem, len, hs->seed[0], hs->seed[1]);
+  }
+  return hashcode_n(elem, len);
+}
+
+// Returns the index ("bucket") for hash code `hc` in a table of
+// `table_size` buckets. In the power of two modes this is the low bits
+// of `hc`. Otherwise negative hash codes are negated to make them
+// positive and the result is taken modulo `table_size`; negation is
+// done unsigned so that INT_MIN does not stay negative.
+static int hashset_bucket(hashset_t *hs, int hc, int table_size){
+  if(hs->hash_mode != HASHSET_HASH_PRIME){
+    return (uint32_t) hc & (table_size - 1);
+  }
+  uint32_t uhc = hc < 0 ? -(uint32_t) hc : (uint32_t) hc;
+  return uhc % table_size;                    // modulo to fit into a smaller index
+}
+
+// Returns the size an expand grows a table of `table_size` buckets
+// to: double in the power of two modes, otherwise
+// next_prime(2*table_size+1) to keep the size prime.
+static int hashset_grow_size(hashset_t *hs, int table_size){
+  if(hs->hash_mode != HASHSET_HASH_PRIME){
+    return table_size * 2;
+  }
+  return next_prime(2*table_size+1);
+}
+
+// Returns the size hashset_remove() shrinks a table of `table_size`
+// buckets to, the reverse of hashset_grow_size(): half in the power of
+// two modes, otherwise next_prime(table_size/2).
+static int hashset_shrink_size(hashset_t *hs, int table_size){
+  if(hs->hash_mode != HASHSET_HASH_PRIME){
+    return table_size / 2;
+  }
+  return next_prime(table_size / 2);
+}
+
+// Compares node `n` with the `len` character string `elem` with hash
+// code `hc` in the order of sorted buckets: by hash code, then length,
+// then bytes. Returns a negative number, 0 or a positive number as
+// the node sorts before, equal to or after `elem`.
+static int hashset_sorted_cmp(hashset_t *hs, uint32_t n, char elem[], int len, int hc){
+  hashnode_t *node = &hs->nodes[n];
+  if(node->hash != hc){
+    return node->hash < hc ? -1 : 1;
+  }
+  if(node->elem_len != len){
+    return node->elem_len < len ? -1 : 1;
+  }
+  return memcmp(hashset_elem(hs, n), elem, len);
+}
+
+// Returns the position of the first node of `sorted` that does not
+// sort before `elem`, where it is if present and where it belongs
+// otherwise. Adds the number of nodes compared to `*probes` if
+// `probes` is not NULL.
+static int hashset_sorted_search(hashset_t *hs, hashsorted_t *sorted,
+                                 char elem[], int len, int hc, int *probes){
+  int lo = 0, hi = sorted->count;
+  while(lo < hi){
+    int mid = lo + (hi - lo) / 2;
+    if(probes != NULL){
+      (*probes)++;
+    }
+    if(hashset_sorted_cmp(hs, sorted->nodes[mid], elem, len, hc) < 0){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Returns the index of the node of `sorted` holding `elem` or 0 if
+// there is none.
+static uint32_t hashset_sorted_find(hashset_t *hs, hashsorted_t *sorted,
+                                    char elem[], int len, int hc){
+  int pos = hashset_sorted_search(hs, sorted, elem, len, hc, NULL);
+  if(pos < sorted->count && hashset_sorted_cmp(hs, sorted->nodes[pos], elem, len, hc) == 0){
+    return sorted->nodes[pos];
+  }
+  return 0;
+}
+
+// Sorts the `count` node indices of `nodes` into sorted bucket order
+// with a merge sort using `tmp`, space for `count` more indices.
+static void hashset_sort_nodes(hashset_t *hs, uint32_t *nodes, uint32_t *tmp, int count){
+  if(count < 2){
+    return;
+  }
+  int half = count / 2;
+  hashset_sort_nodes(hs, nodes, tmp, half);
+  hashset_sort_nodes(hs, nodes + half, tmp, count - half);
+  memcpy(tmp, nodes, sizeof(uint32_t) * count);
+  int i = 0, j = half, k = 0;
+  while(i < half && j < count){
+    hashnode_t *b = &hs->nodes[tmp[j]];
+    if(hashset_sorted_cmp(hs, tmp[i], hashset_elem(hs, tmp[j]), b->elem_len, b->hash) <= 0){
+      nodes[k++] = tmp[i++];
+    }else{
+      nodes[k++] = tmp[j++];
+    }
+  }
+  while(i < half){
+    nodes[k++] = tmp[i++];
+  }
+  while(j < count){
+    nodes[k++] = tmp[j++];
+  }
+}
+
+// Converts bucket `index` of the current table, a chain of `count`
+// nodes, to a sorted array. Allocates the `sorted` array of the table
+// on the first conversion. The array gets room to grow by half again
+// before it has to be reallocated. A sorted array only speeds up
+// lookups so if memory runs out the bucket is left as a plain chain.
+static void hashset_sort_bucket(hashset_t *hs, int index, int count){
+  if(hs->sorted == NULL){
+    hs->sorted = calloc(hs->table_size, sizeof(hashsorted_t*));
+    if(hs->sorted == NULL){
+      return;
+    }
+  }
+  int capacity = count + count / 2;
+  hashsorted_t *sorted = malloc(sizeof(hashsorted_t) + sizeof(uint32_t) * capacity);
+  uint32_t *tmp = malloc(sizeof(uint32_t) * count);
+  if(sorted == NULL || tmp == NULL){
+    free(sorted);
+    free(tmp);
+    return;
+  }
+  sorted->count = count;
+  sorted->capacity = capacity;
+  int i = 0;
+  for(uint32_t n = hs->table[index]; n != 0; n = hs->nodes[n].table_next){
+    sorted->nodes[i++] = n;
+  }
+  hashset_sort_nodes(hs, sorted->nodes, tmp, count);
+  free(tmp);
+  hs->sorted[index] = sorted;
+}
+
+// Returns the number of nodes in the chain of bucket `index` of the
+// current table.
+static int hashset_chain_length(hashset_t *hs, int index){
+  int count = 0;
+  for(uint32_t n = hs->table[index]; n != 0; n = hs->nodes[n].table_next){
+    count++;
+  }
+  return count;
+}
 
-  for(int i= 0; i < table_size; i++){ // makes all elements NULL
-    hs->table[i] = NULL;
+// Converts every bucket of the current table whose entry in `lengths`,
+// the lengths of the chains counted up to HASHSET_SORT_CHAIN as they
+// were built, shows it is long. Used after the whole table is linked
+// at once, which leaves long chains unconverted.
+static void hashset_sort_long_buckets(hashset_t *hs, unsigned char *lengths){
+  for(int i = 0; i < hs->table_size; i++){
+    if(lengths[i] == HASHSET_SORT_CHAIN){
+      hashset_sort_bucket(hs, i, hashset_chain_length(hs, i));
+    }
+  }
+}
+
+// Inserts node `n`, just pushed on the chain of bucket `index` of the
+// current table, into the bucket's sorted array if it has one. If the
+// array can't grow it is dropped and the bucket is a plain chain again.
+static void hashset_sorted_insert(hashset_t *hs, int index, uint32_t n){
+  if(hs->sorted == NULL || hs->sorted[index] == NULL){
+    return;
+  }
+  hashsorted_t *sorted = hs->sorted[index];
+  if(sorted->count == sorted->capacity){
+    hashsorted_t *grown = realloc(sorted, sizeof(hashsorted_t) + sizeof(uint32_t) * sorted->capacity * 2);
+    if(grown == NULL){
+      free(sorted);
+      hs->sorted[index] = NULL;
+      return;
+    }
+    sorted = grown;
+    sorted->capacity *= 2;
+    hs->sorted[index] = sorted;
+  }
+  hashnode_t *node = &hs->nodes[n];
+  int pos = hashset_sorted_search(hs, sorted, hashset_elem(hs, n), node->elem_len, node->hash, NULL);
+  memmove(&sorted->nodes[pos+1], &sorted->nodes[pos], sizeof(uint32_t) * (sorted->count - pos));
+  sorted->nodes[pos] = n;
+  sorted->count++;
+}
+
+// De-allocates the sorted arrays in `sorted`, a per bucket array for a
+// table of `table_size` buckets, and `sorted` itself. Does nothing if
+// `sorted` is NULL.
+static void hashset_free_sorted(hashsorted_t **sorted, int table_size){
+  if(sorted == NULL){
+    return;
+  }
+  for(int i = 0; i < table_size; i++){
+    free(sorted[i]);
+  }
+  free(sorted);
+}
+
+// Searches bucket `index` of the current table for the `len`
+// character string `elem` with hash code `hc` and returns the index of
+// its node or 0 if it is not present. A converted bucket is binary searched.
+// Otherwise the chain is walked; each node caches the hash code of its
+// element so nodes whose hash or length differ are skipped without
+// touching the string arena and only full matches are confirmed with
+// memcmp(). If `walked` is not NULL it is set to the number of chain
+// nodes passed over, the whole chain when `elem` is not present, and
+// to 0 for a converted bucket; hashset_add_hashed() uses this to
+// convert a chain once it is long. Lookups never change the set.
+static uint32_t hashset_find_in(hashset_t *hs, int index, char elem[], int len, int hc,
+                                int *walked){
+  if(hs->sorted != NULL && hs->sorted[index] != NULL){
+    if(walked != NULL){
+      *walked = 0;
+    }
+    return hashset_sorted_find(hs, hs->sorted[index], elem, len, hc);
+  }
+  int count = 0;
+  uint32_t curr = hs->table[index];
+  while(curr != 0){
+    hashnode_t *curr_node = &hs->nodes[curr];
+    if(curr_node->hash == hc && curr_node->elem_len == len &&
+       memcmp(elem, hashset_elem(hs, curr), len) == 0){
+      break;
+    }
+    curr = curr_node->table_next;             // iterate so that it moves to next
+    count++;
+  }
+  if(walked != NULL){
+    *walked = count;
+  }
+  return curr;
+}
+
+// Searches bucket `index` of the old table during an incremental
+// resize like hashset_find_in().
+static uint32_t hashset_find_in_old(hashset_t *hs, int index, char elem[], int len, int hc){
+  if(hs->old_sorted != NULL && hs->old_sorted[index] != NULL){
+    return hashset_sorted_find(hs, hs->old_sorted[index], elem, len, hc);
+  }
+  for(uint32_t n = hs->old_table[index]; n != 0; n = hs->nodes[n].table_next){
+    hashnode_t *node = &hs->nodes[n];
+    if(node->hash == hc && node->elem_len == len &&
+       memcmp(elem, hashset_elem(hs, n), len) == 0){
+      return n;
+    }
+  }
+  return 0;
+}
+
+// Returns the index of the node for `elem` or 0 if it is not present.
+// While an incremental resize is in progress an elem may still sit in
+// the old table so its bucket there is searched as well.
+static uint32_t hashset_find(hashset_t *hs, char elem[], int len, int hc){
+  uint32_t n = hashset_find_in(hs, hashset_bucket(hs, hc, hs->table_size), elem, len, hc, NULL);
+  if(n == 0 && hs->old_table != NULL){
+    n = hashset_find_in_old(hs, hashset_bucket(hs, hc, hs->old_table_size), elem, len, hc);
+  }
+  return n;
+}
+
+// Moves up to `steps` buckets of the old table into the current table
+// during an incremental resize, pushing each node on the front of its
+// new bucket. Once the last old bucket is moved the old table is
+// free()'d and the resize is complete. Each call does a bounded
+// amount of work so no single add or contains pays for moving every
+// node. The sorted arrays of the old bucket and of any new bucket that
+// receives nodes are dropped; the next add to the new bucket converts
+// it again if it is still long.
+static void hashset_rehash_some(hashset_t *hs, int steps){
+  while(steps > 0 && hs->rehash_index < hs->old_table_size){
+    uint32_t current = hs->old_table[hs->rehash_index];
+    while(current != 0){
+      hashnode_t *node = &hs->nodes[current];
+      uint32_t next = node->table_next;
+      int index = hashset_bucket(hs, node->hash, hs->table_size);
+      node->table_next = hs->table[index];
+      hs->table[index] = current;
+      if(hs->sorted != NULL && hs->sorted[index] != NULL){
+        free(hs->sorted[index]);
+        hs->sorted[index] = NULL;
+      }
+      current = next;
+    }
+    hs->old_table[hs->rehash_index] = 0;
+    if(hs->old_sorted != NULL){
+      free(hs->old_sorted[hs->rehash_index]);
+      hs->old_sorted[hs->rehash_index] = NULL;
+    }
+    hs->rehash_index++;
+    steps--;
+  }
+  if(hs->rehash_index >= hs->old_table_size){
+    free(hs->old_table);
+    free(hs->old_sorted);                        // every entry was freed as its bucket moved
+    hs->old_sorted = NULL;
+    hs->old_table = NULL;
+    hs->old_table_size = 0;
+    hs->rehash_index = 0;
   }
 }
 
 // Returns 1 if the parameter `elem` is in the hash set and 0
 // otherwise. Uses hashcode() and field `table_size` to determine
 // which index in table to search.  Iterates through the list at that
-// table index using strcmp() to check for `elem`. NOTE: The
+// table index comparing the cached hash code of each node before
+// checking the string itself. During an incremental resize, first
+// moves `rehash_step` buckets of the old table. NOTE: The
 // `hashcode()` function may return positive or negative
 // values. Negative values are negated to make them positive. The
 // "bucket" (index in hs->table) for `elem` is determined by with
-// 'hashcode(key) modulo table_size'.
+// 'hashcode(key) modulo table_size' or, in HASHSET_HASH_POW2 and
+// HASHSET_HASH_KEYED modes, by masking the low bits of hashcode64() or
+// siphash13().
 int hashset_contains(hashset_t *hs, char elem[]){
-  int hc = hashcode(elem);
-  if(hc < 0)
-    hc *= -1;
+  return hashset_contains_n(hs, elem, strlen(elem));
+}
 
-  int index = hc % hs->table_size; // modulo to fit into a smaller index
-  hashnode_t *curr_node = hs->table[index]; // correct index for first node of table
-  while(curr_node != NULL){
-    if(strcmp(elem, curr_node->elem) == 0){ // compare elem to the one of the current node we are at
-      return 1;
-    }
-    curr_node = curr_node->table_next; // iterate so that it moves to next
+// Same as hashset_contains() for the `len` characters at `elem`, which
+// need not be '\0' terminated: a key can be looked up straight out of
+// a read buffer or mapped file without copying it. Hashing and
+// comparison only ever look at those `len` characters, lengths first
+// and then memcmp().
+int hashset_contains_n(hashset_t *hs, char elem[], int len){
+  if(hs->old_table != NULL){
+    hashset_rehash_some(hs, hs->rehash_step);
   }
-  return 0;
+  return hashset_find(hs, elem, len, hashset_hash(hs, elem, len)) != 0;
 }
 
-// If the element is already present in the hash set, makes no changes
-// to the hash set and returns 0. hashset_contains() may be used for
-// this. Otherwise determines the bucket to add `elem` at via the same
-// process as in hashset_contains() and adds it to the FRONT of the
-// list at that table index. Adjusts the `hs->order_last` pointer to
-// append the new element to the ordered list of elems. If this is the
-// first element added, also adjsuts the `hs->first` pointer. Updates the
-// `elem_count` field and returns 1 to indicate a successful addition.
-//
-// NOTE: Adding elems at the front of each bucket list allows much
-// simplified logic that does not need any looping/iteration.
-int hashset_add(hashset_t *hs, char elem[]){
-  if(hashset_contains(hs, elem)){
-    return 0;
+// Hashes the `count` (at most HASHSET_BATCH) strings `elems` into
+// `lens` and `hcs` and prefetches in three passes what a lookup of
+// each will touch: the bucket heads of the current table, then the
+// first node of each chain, then the string of any first node whose
+// cached hash matches. Each pass issues every load of the batch before
+// the next needs their results so cache misses on different keys
+// overlap instead of being waited out one after another. Prefetches
+// are hints; nothing is read through them so a stale one is harmless.
+static void hashset_prefetch_batch(hashset_t *hs, char *elems[], int count,
+                                   int lens[], int hcs[]){
+  int index[HASHSET_BATCH];
+  for(int i = 0; i < count; i++){
+    lens[i] = strlen(elems[i]);
+    hcs[i] = hashset_hash(hs, elems[i], lens[i]);
+    index[i] = hashset_bucket(hs, hcs[i], hs->table_size);
+    __builtin_prefetch(&hs->table[index[i]]);
   }
-  int hc = hashcode(elem);
-  if(hc < 0)                                  // if negative multiply by -1 to get a positive
-    hc *= -1;
+  uint32_t heads[HASHSET_BATCH];
+  for(int i = 0; i < count; i++){
+    heads[i] = hs->table[index[i]];
+    if(heads[i] != 0){
+      __builtin_prefetch(&hs->nodes[heads[i]]);
+    }
+  }
+  for(int i = 0; i < count; i++){
+    if(heads[i] != 0 && hs->nodes[heads[i]].hash == hcs[i]){
+      __builtin_prefetch(hs->keys.bytes + hs->nodes[heads[i]].elem_off);
+    }
+  }
+}
 
-  int index = hc % hs->table_size;            // determines bucket
-  hashnode_t *newNode = malloc(sizeof(hashnode_t));
-  strcpy(newNode->elem, elem);
+// Looks up each of the `count` strings in `elems` and returns how many
+// are present. If `found` is not NULL it is a bitmap of at least
+// (count+7)/8 bytes: bit i%8 of byte i/8 is set if elems[i] is present
+// and cleared otherwise. Gives the same answers as calling
+// hashset_contains() on each but works through HASHSET_BATCH keys at a
+// time with hashset_prefetch_batch() so that, in a table much larger
+// than the cache, a lookup mostly finds its bucket, node and string
+// already loaded. During an incremental resize the batch first moves
+// `rehash_step` buckets per key, as the scalar lookups would.
+int hashset_contains_many(hashset_t *hs, char *elems[], int count, unsigned char found[]){
+  if(found != NULL){
+    memset(found, 0, (count + 7) / 8);
+  }
+  int present = 0;
+  int lens[HASHSET_BATCH], hcs[HASHSET_BATCH];
+  for(int start = 0; start < count; start += HASHSET_BATCH){
+    int batch = count - start < HASHSET_BATCH ? count - start : HASHSET_BATCH;
+    if(hs->old_table != NULL){
+      hashset_rehash_some(hs, hs->rehash_step * batch);
+    }
+    hashset_prefetch_batch(hs, elems + start, batch, lens, hcs);
+    for(int i = 0; i < batch; i++){
+      if(hashset_find(hs, elems[start+i], lens[i], hcs[i]) != 0){
+        present++;
+        if(found != NULL){
+          found[(start+i) / 8] |= 1 << ((start+i) % 8);
+        }
+      }
+    }
+  }
+  return present;
+}
 
-  if(hs->elem_count == 0){                    //if order_first is NULL (or empty)
-    hs->order_first = newNode;                // make the first node be the one that was made
-  }else{
-    hs->order_last->order_next = newNode;       // otherwise set the LATEST one (accessed through last->next) as new node
+// Returns the number of nodes a lookup of `elem` examines: its
+// position in its chain if present, otherwise the length of its chain,
+// including the old table's chain during an incremental resize. For a
+// bucket converted to a sorted array it is the number of nodes the
+// binary search compares plus the final check. Does not move or
+// convert any buckets so it can be used to measure a set without
+// changing it.
+int hashset_probe_count(hashset_t *hs, char elem[]){
+  int len = strlen(elem);
+  int hc = hashset_hash(hs, elem, len);
+  int index = hashset_bucket(hs, hc, hs->table_size);
+  uint32_t chains[2] = {hs->table[index], 0};
+  hashsorted_t *sorted[2] = {hs->sorted == NULL ? NULL : hs->sorted[index], NULL};
+  if(hs->old_table != NULL){
+    index = hashset_bucket(hs, hc, hs->old_table_size);
+    chains[1] = hs->old_table[index];
+    sorted[1] = hs->old_sorted == NULL ? NULL : hs->old_sorted[index];
   }
+  int probes = 0;
+  for(int t = 0; t < 2; t++){
+    if(sorted[t] != NULL){
+      int pos = hashset_sorted_search(hs, sorted[t], elem, len, hc, &probes);
+      if(pos < sorted[t]->count){
+        probes++;
+        if(hashset_sorted_cmp(hs, sorted[t]->nodes[pos], elem, len, hc) == 0){
+          return probes;
+        }
+      }
+      continue;
+    }
+    for(uint32_t n = chains[t]; n != 0; n = hs->nodes[n].table_next){
+      hashnode_t *node = &hs->nodes[n];
+      probes++;
+      if(node->hash == hc && node->elem_len == len &&
+         memcmp(elem, hashset_elem(hs, n), len) == 0){
+        return probes;
+      }
+    }
+  }
+  return probes;
+}
 
-  newNode->order_next = NULL;                         // initializes empty next for the new node
-  hs->order_last = newNode;
+// Hands out the next node of the `nodes` array of `hs` and returns
+// its index, doubling the array when it is full. Nodes are referred to
+// by index rather than pointer so they may move when it grows. Index 0
+// is skipped so that 0 can mean no node.
+static uint32_t hashset_node_alloc(hashset_t *hs){
+  uint32_t n = ++hs->node_count;
+  if(n >= (uint32_t) hs->nodes_cap){
+    hs->nodes_cap = hs->nodes_cap == 0 ? HASHSET_MIN_NODES : hs->nodes_cap * 2;
+    hs->nodes = realloc(hs->nodes, sizeof(hashnode_t) * hs->nodes_cap);
+  }
+  return n;
+}
 
-  if(hs->table[index] == NULL){               // Test case where table at index is NULL
-    hs->table[index] = newNode;
-    newNode->table_next = NULL;
+// Adds the `len` character string `elem` with hash code `hc` to `hs`
+// unless it is already present. Does the work of hashset_add() for
+// callers that already know the hash code so it is never recomputed.
+static int hashset_add_hashed(hashset_t *hs, char elem[], int len, int hc){
+  if(hs->old_table != NULL){
+    hashset_rehash_some(hs, hs->rehash_step);
+  }
+  int index = hashset_bucket(hs, hc, hs->table_size); // determines bucket
+  int chain;                                     // nodes already in the bucket's chain on a miss
+  if(hashset_find_in(hs, index, elem, len, hc, &chain) != 0 ||
+     (hs->old_table != NULL &&
+      hashset_find_in_old(hs, hashset_bucket(hs, hc, hs->old_table_size), elem, len, hc) != 0)){
+    return 0;
+  }
+  uint32_t n = hashset_node_alloc(hs);
+  hashnode_t *newNode = &hs->nodes[n];
+  newNode->elem_off = strarena_add(&hs->keys, elem, len);
+  newNode->elem_len = len;
+  newNode->hash = hc;
+  newNode->table_next = hs->table[index];     // push on the front of the bucket, 0 if it was empty
+  hs->table[index] = n;
+  if(chain + 1 >= HASHSET_SORT_CHAIN){           // a plain chain long enough to convert, the walk above counted it
+    hashset_sort_bucket(hs, index, chain + 1);
   }else{
-    newNode->table_next = hs->table[index];
-    hs->table[index] = newNode;
+    hashset_sorted_insert(hs, index, n);
   }
   hs->elem_count++;                              // iterate elem_count
+  if(hs->max_load > 0 && hs->old_table == NULL &&
+     hs->elem_count > hs->max_load * hs->table_size){
+    hashset_expand(hs);                          // keep load factor under the limit
+  }
   return 1;
 }
 
-// De-allocates nodes/table for `hs`. Iterates through the ordered
-// list of the hash set starting at the `order_first` field and
-// de-allocates all nodes in the list. Also free's the `table`
-// field. Sets all relevant fields to 0 or NULL as appropriate to
-// indicate that the hash set has no more usable space. Does NOT
-// attempt to de-allocate the `hs` itself as it may not be
-// heap-allocated (e.g. in the stack or a global).
-void hashset_free_fields(hashset_t *hs){
-  hashnode_t *current = hs->order_first;
-  while(current != NULL){
-    hashnode_t *next = current->order_next;
-    free(current);
-    current = next;
+// If the element is already present in the hash set, makes no changes
+// to the hash set and returns 0. Otherwise determines the bucket to
+// add `elem` at via the same process as in hashset_contains() and
+// adds it to the FRONT of the list at that table index. The new node
+// is the next one of the `hs->nodes` array so that array holds the
+// elems in the order they were added; an elem that was removed and
+// added again goes to the end. Updates the `elem_count` field and returns 1 to
+// indicate a successful addition. The hash code is computed once and
+// cached in the new node. If the addition pushes the load factor past
+// `max_load`, the table is expanded with hashset_expand(). During an
+// incremental resize, first moves `rehash_step` buckets of the old
+// table and does not start another resize until that one completes.
+//
+// NOTE: Adding elems at the front of each bucket list allows much
+// simplified logic that does not need any looping/iteration.
+int hashset_add(hashset_t *hs, char elem[]){
+  return hashset_add_n(hs, elem, strlen(elem));
+}
+
+// Same as hashset_add() for the `len` characters at `elem`, which need
+// not be '\0' terminated. Only those characters are copied into the
+// string arena, where they are stored with a terminating '\0' so the
+// elements still print as C strings.
+int hashset_add_n(hashset_t *hs, char elem[], int len){
+  return hashset_add_hashed(hs, elem, len, hashset_hash(hs, elem, len));
+}
+
+// Adds each of the `count` strings in `elems` to `hs` in order, as
+// calling hashset_add() on each would, and returns how many were
+// added; duplicates within `elems` are added once. Hashes and
+// prefetches HASHSET_BATCH keys at a time with
+// hashset_prefetch_batch() so the presence check of each add overlaps
+// its cache misses with those of the rest of the batch. An expand
+// partway through a batch only makes the remaining prefetches miss.
+int hashset_add_many(hashset_t *hs, char *elems[], int count){
+  int added = 0;
+  int lens[HASHSET_BATCH], hcs[HASHSET_BATCH];
+  for(int start = 0; start < count; start += HASHSET_BATCH){
+    int batch = count - start < HASHSET_BATCH ? count - start : HASHSET_BATCH;
+    hashset_prefetch_batch(hs, elems + start, batch, lens, hcs);
+    for(int i = 0; i < batch; i++){
+      added += hashset_add_hashed(hs, elems[start+i], lens[i], hcs[i]);
+    }
   }
+  return added;
+}
+
+// De-allocates nodes/table for `hs`. Nodes live in the `nodes` array
+// so they are released with it rather than by free()'ing each one.
+// Also free's the `table` field and the string arena. Sets all
+// relevant fields to 0 or NULL as appropriate to indicate that the
+// hash set has no more usable space. Does NOT attempt to de-allocate
+// the `hs` itself as it may not be heap-allocated (e.g. in the stack
+// or a global).
+void hashset_free_fields(hashset_t *hs){
+  free(hs->nodes);
+  hs->nodes = NULL;
+  hs->node_count = 0;
+  hs->nodes_cap = 0;
+  strarena_free(&hs->keys);  // frees string arena
   free(hs->table); // frees table field
+  hashset_free_sorted(hs->sorted, hs->table_size);
+  hs->sorted = NULL;
+  free(hs->old_table);
+  hashset_free_sorted(hs->old_sorted, hs->old_table_size);
+  hs->old_sorted = NULL;
+  hs->old_table = NULL;
+  hs->old_table_size = 0;
+  hs->rehash_index = 0;
 
-  hs->order_last = NULL; 
-  hs->order_first = NULL;
   hs->elem_count = 0; 
   hs->table_size = 0;
 
 }
 
-// Displays detailed structure of the hash set. Shows stats for the
-// hash set as below including the load factor (element count divided
-// by table_size) to 4 digits of accuracy.  Then shows each table
-// array index ("bucket") on its own line with the linked list of
-// elems in the bucket on the same line. 
+// Displays detailed structure of the hash set. Any incremental resize
+// in progress is completed first so a single table is shown. Shows
+// stats for the hash set as below including the load factor
+// (element count divided by table_size) to 4 digits of accuracy.
+// Then shows each table array index ("bucket") on its own line with
+// the linked list of elems in the bucket on the same line.
 // 
 // EXAMPLE:
 // elem_count: 4
@@ -149,26 +888,30 @@ void hashset_free_fields(hashset_t *hs){
 //
 // NOTES:
 // - Uses format specifier "[%2d] : " to print the table indices
+// - Buckets converted to sorted arrays end with "(sorted)" after their
+//   nodes, which are still shown in chain order
 // - Nodes in buckets have the following format:
 //   {1415930697 IceT >>Goldenfold}
 //    |          |       |        
-//    |          |       +-> order_next->elem OR NULL if last node
+//    |          |       +-> elem added next OR NULL if last node
 //    |          +->`elem` string     
-//    +-> hashcode("IceT"), print using format "%ld" for 64-bit longs
+//    +-> hashcode("IceT") as cached in the node
 // 
 void hashset_show_structure(hashset_t *hs){
+  hashset_rehash_finish(hs);
   printf("elem_count: %d\n", hs->elem_count);
   printf("table_size: %d\n", hs->table_size);
 
-  if(hs->order_first->elem == NULL){
+  if(hs->elem_count == 0){
     printf("order_first: %s\n", "NULL");
-  }else{
-    printf("order_first: %s\n", hs->order_first->elem);
-  }
-  if(hs->order_last->elem == NULL){
     printf("order_last : %s\n", "NULL");
   }else{
-    printf("order_last : %s\n", hs->order_last->elem);
+    printf("order_first: %s\n", hashset_elem(hs, hashset_next_present(hs, 0)));
+    uint32_t last = hs->node_count;
+    while(hs->nodes[last].elem_len < 0){
+      last--;
+    }
+    printf("order_last : %s\n", hashset_elem(hs, last));
   }
 
   double load_fact = (double)hs->elem_count / (double)hs->table_size;
@@ -176,29 +919,33 @@ void hashset_show_structure(hashset_t *hs){
 
   for(int i = 0; i < hs->table_size; i++){
     if(i <= 9){                           // if 1 digit,
-      if(hs->table[i] == NULL){               // if bucket is empty, print with spacing and line break
+      if(hs->table[i] == 0){                  // if bucket is empty, print with spacing and line break
         printf("[ %d] :\n", i);
       }else{                                   // else, this spacing
         printf("[ %d] : ", i);
       }
     }else{                                // if more than one digit
-      if(hs->table[i] == NULL){
+      if(hs->table[i] == 0){
         printf("[%d] :\n", i);
       }else{
         printf("[%d] : ", i);
       }
     }
-    hashnode_t *current_arr = hs->table[i];
-    while(current_arr != NULL){                                   // current bucket that we are working accessing
+    uint32_t current = hs->table[i];
+    while(current != 0){                                          // current bucket that we are working accessing
 
-      printf("{%d %s >>", hashcode(current_arr->elem), current_arr->elem);
-      if(current_arr->order_next == NULL){
+      printf("{%d %s >>", hs->nodes[current].hash, hashset_elem(hs, current));
+      uint32_t next = hashset_next_present(hs, current);          // nodes are in insertion order
+      if(next == 0){
         printf("NULL} ");
       }else{
-        printf("%s} ", current_arr->order_next->elem);
+        printf("%s} ", hashset_elem(hs, next));
       }
-      current_arr = current_arr->table_next;                      // if the bucket has no more nodes to print, go to next line
-      if(current_arr == NULL){
+      current = hs->nodes[current].table_next;                    // if the bucket has no more nodes to print, go to next line
+      if(current == 0){
+        if(hs->sorted != NULL && hs->sorted[i] != NULL){
+          printf("(sorted)");
+        }
         printf("\n");
       }
       
@@ -207,19 +954,18 @@ void hashset_show_structure(hashset_t *hs){
 }
 
 // Outputs all elements of the hash set according to the order they
-// were added. Starts at the `order_first` field and iterates through
-// the list defined there. Each element is printed on its own line
+// were added, a sequential scan of the `nodes` array skipping removed
+// nodes. Each element is printed on its own line
 // preceded by its add position with 1 for the first elem, 2 for the
 // second, etc. Prints output to `FILE *out` which should be an open
 // handle. NOTE: the output can be printed to the terminal screen by
 // passing in the `stdout` file handle for `out`.
 void hashset_write_elems_ordered(hashset_t *hs, FILE *out){
-  hashnode_t *current = hs->order_first;
   int order_num = 1;
-  while(current != NULL){                                       // if current hs->order_first isnt NULL
-    fprintf(out, "   %d %s\n", order_num, current->elem);       // print order num and element of current hs->order_first
-    current = current->order_next;                              // iterates through
-    order_num++;
+  for(int i = 1; i <= hs->node_count; i++){
+    if(hs->nodes[i].elem_len >= 0){
+      fprintf(out, "   %d %s\n", order_num++, hashset_elem(hs, i)); // print order num and element
+    }
   }
 }
 
@@ -239,18 +985,82 @@ void hashset_write_elems_ordered(hashset_t *hs, FILE *out){
 // 
 // First two numbers are the 'table_size' and 'elem_count' field and
 // remaining text is the output of hashset_write_elems_ordered();
-// e.g. insertion position and element.
+// e.g. insertion position and element. A set in HASHSET_HASH_KEYED
+// mode adds its seed to the first line as two hex numbers,
+//
+// 8 6 2f0c64a1d8e3b7f5 91ab37c2e05d4f68
+//
+// so that hashset_load() hashes with the same seed.
 void hashset_save(hashset_t *hs, char *filename){
   FILE *file = fopen(filename, "w");
   if(file == NULL){
     printf("ERROR: could not open file '%s'\n", filename);
   }else{
-    fprintf(file, "%d %d\n", hs->table_size, hs->elem_count);       // print table size and elem count into that file
+    fprintf(file, "%d %d", hs->table_size, hs->elem_count);         // print table size and elem count into that file
+    if(hs->hash_mode == HASHSET_HASH_KEYED){
+      fprintf(file, " %016llx %016llx", (unsigned long long) hs->seed[0],
+              (unsigned long long) hs->seed[1]);
+    }
+    fprintf(file, "\n");
     hashset_write_elems_ordered(hs, file);                          // use to write elems
     fclose(file);
   }
 }
 
+// Reads the first line of a file written by hashset_save() which is
+// open as `file` into `*size` and `*count`. If the line also holds the
+// seed of a HASHSET_HASH_KEYED set, stores it in `seed` and returns 1,
+// otherwise leaves `seed` alone and returns 0. Shared by the loaders of
+// all hash set implementations; those that don't hash with a seed
+// ignore it.
+int hashset_read_header(FILE *file, int *size, int *count, uint64_t seed[2]){
+  char *line = NULL;
+  size_t line_cap = 0;
+  int fields = 0;
+  unsigned long long seed0, seed1;
+  if(getline(&line, &line_cap, file) != -1){
+    fields = sscanf(line, "%d %d %llx %llx", size, count, &seed0, &seed1);
+  }
+  free(line);
+  if(fields < 4){
+    return 0;
+  }
+  seed[0] = seed0;
+  seed[1] = seed1;
+  return 1;
+}
+
+// Reads the next elem from a file written by hashset_save() which is
+// open as `file` and positioned after the header. Lines are read whole
+// with getline() into `*line`, which is grown as needed, so elems of
+// any length are handled. The insertion index at the start of the
+// line is skipped and blank lines (such as the end of the header line)
+// are passed over. Sets `*elem` to the '\0'-terminated elem within
+// `*line` and returns its length, or returns -1 at the end of the
+// file. Shared by the loaders of all hash set implementations.
+int hashset_read_elem(FILE *file, char **line, size_t *line_cap, char **elem){
+  while(getline(line, line_cap, file) != -1){
+    char *start = *line;
+    while(*start == ' ' || *start == '\t'){              // skip leading space
+      start++;
+    }
+    while(*start == '-' || (*start >= '0' && *start <= '9')){ // skip insertion index
+      start++;
+    }
+    while(*start == ' ' || *start == '\t'){
+      start++;
+    }
+    int len = strcspn(start, " \t\r\n");                 // elem runs to next whitespace
+    if(len == 0){                                         // blank line such as the end of the header
+      continue;
+    }
+    start[len] = '\0';
+    *elem = start;
+    return len;
+  }
+  return -1;
+}
+
 // Loads a hash set file created with hashset_save(). If the file
 // cannot be opened, prints the message
 // 
@@ -260,11 +1070,17 @@ void hashset_save(hashset_t *hs, char *filename){
 // current hash set `hs`, initializes a new one based on the size
 // present in the file, and adds all elems from the file into the new
 // hash set. Ignores the indices at the start of each line and uses
-// hashset_add() to insert elems in the order they appear in the
-// file. Returns 1 on successful loading (FIXED: previously indicated
-// a different return value on success) . This function does no error
-// checking of the contents of the file so if they are corrupted, it
-// may cause an application to crash or loop infinitely.
+// hashset_add_n() to insert elems in the order they appear in the
+// file, straight out of the line buffer with the length
+// hashset_read_elem() found so they are neither copied nor rescanned.
+// The hash mode, `max_load` and `rehash_step` of `hs` are kept and,
+// if set, the table is grown up front to hold all elems under it. A
+// file saved in HASHSET_HASH_KEYED mode switches `hs` to that mode
+// with the saved seed. Lines are read whole with getline() so elems
+// of any length are loaded. Returns 1 on successful loading. This
+// function does no error checking of the contents of the file so if
+// they are corrupted, it may cause an application to crash or loop
+// infinitely.
 int hashset_load(hashset_t *hs, char *filename){   
   FILE *file = fopen(filename, "r");
   if(file == NULL){
@@ -273,66 +1089,942 @@ int hashset_load(hashset_t *hs, char *filename){
   }
   int size;
   int count;
-  fscanf(file, "%d %d", &size, &count);                   // reads in size and count from file
+  uint64_t seed[2] = {hs->seed[0], hs->seed[1]};
+  int hash_mode = hs->hash_mode;
+  if(hashset_read_header(file, &size, &count, seed)){    // reads in size, count and any seed from file
+    hash_mode = HASHSET_HASH_KEYED;                       // a saved seed is used as is
+  }
+  double max_load = hs->max_load;                         // loading keeps the configured growth settings
+  int rehash_step = hs->rehash_step;
   hashset_free_fields(hs);                                // frees fields of current hs
-  hashset_init(hs, size);                                 // initialize new hs to correct size
-  for(int i = 0; i < count; i++){                         // iterate through count pulled from the data file
-    char elem[128];                                       // initializing char item[byte]
-    fscanf(file, "%*d %s", elem);
-    hashset_add(hs, elem);                                // add elem to hs
+  hashset_init_seeded(hs, size, hash_mode, seed);         // initialize new hs to correct size
+  hashset_set_max_load(hs, max_load);
+  hashset_set_rehash_step(hs, rehash_step);
+  hashset_reserve(hs, count);                             // size once rather than expanding during adds
+  char *line = NULL;                                      // buffer grown by getline() as needed
+  size_t line_cap = 0;
+  char *elem;
+  int len;
+  for(int i = 0; i < count && (len = hashset_read_elem(file, &line, &line_cap, &elem)) >= 0; i++){
+    hashset_add_n(hs, elem, len);                         // add elem to hs, its length is known
   }
+  free(line);
   fclose(file);
   return 1;
 }
 
+// Identifies files written by hashset_save_binary(); followed by the
+// rest of a hashset_file_header_t
+static const char hashset_file_magic[8] = "HSBINARY";
+
+// Type for the header at the start of a file written by
+// hashset_save_binary(). The fields leave no padding and add up to a
+// multiple of 8 bytes so the arrays after it are aligned in a mapped
+// file.
+typedef struct {
+  char magic[8];                // hashset_file_magic
+  uint32_t version;             // HASHSET_FILE_VERSION
+  int32_t table_size;           // table_size of the saved set
+  int32_t elem_count;           // elements saved, removed ones are skipped
+  int32_t hash_mode;            // hash_mode of the saved set, which the cached hashes depend on
+  uint64_t seed[2];             // seed of the saved set, 0 outside HASHSET_HASH_KEYED mode
+  uint64_t keys_len;            // bytes of the packed elements at the end of the file
+  uint64_t checksum;            // hashset_checksum() of everything after the header
+} hashset_file_header_t;
+
+// Type for the buffer hashset_save_binary() writes through, which
+// checksums the file as it goes.
+typedef struct {
+  FILE *file;                   // file being written
+  char *buf;                    // HASHSET_FILE_BLOCK bytes waiting to be written
+  int fill;                     // bytes of `buf` in use
+  uint64_t checksum;            // hashset_checksum() of the blocks written so far
+} hashset_writer_t;
+
+// Folds the hashcode64() of the `len` byte block at `block` into
+// `checksum`. A file is checksummed in blocks of HASHSET_FILE_BLOCK
+// bytes, the last one possibly shorter, starting from HASH64_P0.
+static uint64_t hashset_checksum(uint64_t checksum, char *block, int len){
+  return hash_mum(checksum ^ hashcode64(block, len), HASH64_P2);
+}
+
+// Writes the bytes buffered in `w` to its file and adds them to its
+// checksum.
+static void hashset_writer_flush(hashset_writer_t *w){
+  if(w->fill > 0){
+    w->checksum = hashset_checksum(w->checksum, w->buf, w->fill);
+    fwrite(w->buf, 1, w->fill, w->file);
+    w->fill = 0;
+  }
+}
+
+// Appends the `len` bytes at `data` to the buffer of `w`, writing out
+// every block that fills.
+static void hashset_writer_put(hashset_writer_t *w, void *data, size_t len){
+  char *bytes = data;
+  while(len > 0){
+    size_t n = HASHSET_FILE_BLOCK - w->fill;
+    if(n > len){
+      n = len;
+    }
+    memcpy(w->buf + w->fill, bytes, n);
+    w->fill += n;
+    bytes += n;
+    len -= n;
+    if(w->fill == HASHSET_FILE_BLOCK){
+      hashset_writer_flush(w);
+    }
+  }
+}
+
+// Writes `hs` to `filename` in a binary format which
+// hashset_load_binary() maps and rebuilds the set from without
+// parsing or hashing any element. After a hashset_file_header_t come
+// the cached hash code of each element, the length of each and then
+// the elements themselves packed one after another with their '\0's,
+// all in insertion order. The header holds the table size, element
+// count, hash mode and seed needed to reuse the hash codes and a
+// checksum of the rest of the file. The file is only meant to be read
+// on machines with the same byte order.
+void hashset_save_binary(hashset_t *hs, char *filename){
+  FILE *file = fopen(filename, "wb");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  hashset_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, hashset_file_magic, sizeof(header.magic));
+  header.version = HASHSET_FILE_VERSION;
+  header.table_size = hs->table_size;
+  header.elem_count = hs->elem_count;
+  header.hash_mode = hs->hash_mode;
+  header.seed[0] = hs->seed[0];
+  header.seed[1] = hs->seed[1];
+  fwrite(&header, sizeof(header), 1, file);      // rewritten with the checksum at the end
+
+  hashset_writer_t w = {file, malloc(HASHSET_FILE_BLOCK), 0, HASH64_P0};
+  for(int i = 1; i <= hs->node_count; i++){       // hash codes
+    if(hs->nodes[i].elem_len >= 0){
+      int32_t hash = hs->nodes[i].hash;
+      hashset_writer_put(&w, &hash, sizeof(hash));
+    }
+  }
+  for(int i = 1; i <= hs->node_count; i++){       // lengths
+    if(hs->nodes[i].elem_len >= 0){
+      int32_t len = hs->nodes[i].elem_len;
+      hashset_writer_put(&w, &len, sizeof(len));
+    }
+  }
+  for(int i = 1; i <= hs->node_count; i++){       // elements
+    if(hs->nodes[i].elem_len >= 0){
+      hashset_writer_put(&w, hashset_elem(hs, i), hs->nodes[i].elem_len + 1);
+      header.keys_len += hs->nodes[i].elem_len + 1;
+    }
+  }
+  hashset_writer_flush(&w);
+  free(w.buf);
+  header.checksum = w.checksum;
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  fclose(file);
+}
+
+// Loads a file written by hashset_save_binary() into `hs`, replacing
+// its contents. The file is mapped with mmap() rather than read and
+// the set is rebuilt straight from the mapping: the packed elements
+// become the string arena in a single copy and each node takes its
+// hash code and length from the file and is pushed on the front of
+// its bucket in insertion order, which gives the same buckets as
+// adding the elements one by one; chains HASHSET_SORT_CHAIN nodes
+// long are converted to sorted arrays as the adds would. The set
+// takes the hash mode and seed of the file as the saved hash codes
+// are only valid under them; `max_load` and `rehash_step` of `hs` are
+// kept and the table is grown up front if `max_load` calls for it, as
+// in hashset_load(). Prints an error and returns 0, leaving `hs`
+// unchanged, if the file cannot be opened, is not a binary hash set
+// of this version, has the wrong length or checksum or refers outside
+// its elements; otherwise returns 1.
+int hashset_load_binary(hashset_t *hs, char *filename){
+  int fd = open(filename, O_RDONLY);
+  if(fd == -1){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  struct stat st;
+  char *map = MAP_FAILED;
+  if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(hashset_file_header_t)){
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);                                      // the mapping stays valid
+  hashset_file_header_t header;
+  int ok = map != MAP_FAILED;
+  if(ok){
+    memcpy(&header, map, sizeof(header));
+    ok = memcmp(header.magic, hashset_file_magic, sizeof(header.magic)) == 0 &&
+      header.version == HASHSET_FILE_VERSION;
+  }
+  if(!ok){
+    printf("ERROR: '%s' is not a binary hash set file\n", filename);
+    if(map != MAP_FAILED){
+      munmap(map, st.st_size);
+    }
+    return 0;
+  }
+  uint64_t count = header.elem_count;
+  char *payload = map + sizeof(header);
+  uint64_t payload_len = st.st_size - sizeof(header);
+  ok = header.elem_count >= 0 && header.table_size > 0 &&
+    header.hash_mode >= HASHSET_HASH_PRIME && header.hash_mode <= HASHSET_HASH_KEYED &&
+    header.keys_len <= payload_len && payload_len == 2 * sizeof(int32_t) * count + header.keys_len;
+  uint64_t checksum = HASH64_P0;
+  for(uint64_t off = 0; ok && off < payload_len; off += HASHSET_FILE_BLOCK){
+    uint64_t len = payload_len - off < HASHSET_FILE_BLOCK ? payload_len - off : HASHSET_FILE_BLOCK;
+    checksum = hashset_checksum(checksum, payload + off, len);
+  }
+  ok = ok && checksum == header.checksum;
+
+  hashset_t loaded;
+  if(ok){
+    int32_t *hashes = (int32_t *) payload;
+    int32_t *lens = hashes + count;
+    char *elems = (char *) (lens + count);
+    hashset_init_seeded(&loaded, header.table_size, header.hash_mode, header.seed);
+    hashset_set_max_load(&loaded, hs->max_load);
+    hashset_set_rehash_step(&loaded, hs->rehash_step);
+    hashset_reserve(&loaded, count);              // no nodes yet so this only sizes the table
+    loaded.nodes_cap = count + 1;                 // node 0 is never used
+    loaded.nodes = malloc(sizeof(hashnode_t) * loaded.nodes_cap);
+    if(header.keys_len > 0){
+      loaded.keys.bytes = malloc(header.keys_len);
+      memcpy(loaded.keys.bytes, elems, header.keys_len);
+      loaded.keys.len = header.keys_len;
+      loaded.keys.cap = header.keys_len;
+    }
+    unsigned char *lengths = calloc(loaded.table_size, 1); // chain lengths up to HASHSET_SORT_CHAIN
+    uint64_t off = 0;
+    for(uint32_t n = 1; ok && n <= count; n++){
+      int len = lens[n-1];
+      ok = len >= 0 && off + len < header.keys_len && elems[off + len] == '\0';
+      if(ok){
+        hashnode_t *node = &loaded.nodes[n];
+        node->elem_off = off;
+        node->elem_len = len;
+        node->hash = hashes[n-1];
+        int index = hashset_bucket(&loaded, node->hash, loaded.table_size);
+        node->table_next = loaded.table[index];
+        loaded.table[index] = n;
+        if(lengths != NULL && lengths[index] < HASHSET_SORT_CHAIN){
+          lengths[index]++;
+        }
+        loaded.node_count = n;
+        loaded.elem_count = n;
+        off += len + 1;
+      }
+    }
+    if(ok && lengths != NULL){                    // no lengths means no memory to convert with either
+      hashset_sort_long_buckets(&loaded, lengths);
+    }
+    free(lengths);
+    if(!ok){
+      hashset_free_fields(&loaded);
+    }
+  }
+  munmap(map, st.st_size);
+  if(!ok){
+    printf("ERROR: binary hash set file '%s' is truncated or damaged\n", filename);
+    return 0;
+  }
+  hashset_free_fields(hs);
+  *hs = loaded;
+  return 1;
+}
+
+// Computes (a*b) mod m for a, b < m without overflow. Moduli that fit
+// in 32 bits use a plain 64-bit product; larger ones need a (much
+// slower) 128-bit product.
+static uint64_t mulmod64(uint64_t a, uint64_t b, uint64_t m){
+  if(m <= UINT32_MAX){
+    return a * b % m;
+  }
+  return (uint64_t) ((__uint128_t) a * b % m);
+}
+
+// Computes (base^exp) mod m by repeated squaring.
+static uint64_t powmod64(uint64_t base, uint64_t exp, uint64_t m){
+  uint64_t result = 1;
+  base %= m;
+  while(exp > 0){
+    if(exp & 1){
+      result = mulmod64(result, base, m);
+    }
+    base = mulmod64(base, base, m);
+    exp >>= 1;
+  }
+  return result;
+}
+
+// Returns 1 if `n` is prime and 0 otherwise. Small factors are ruled
+// out by trial division, then a Miller-Rabin test is run with a fixed
+// set of bases known to give no false positives: 2, 7, 61 for 32-bit
+// `n` and a set of 7 bases for any 64-bit `n`. The answer is exact
+// and takes at most a few hundred multiplications.
+static int is_prime64(uint64_t n){
+  static const uint64_t small[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+  static const uint64_t bases32[] = {2, 7, 61};
+  static const uint64_t bases64[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+  const uint64_t *bases = n <= UINT32_MAX ? bases32 : bases64;
+  int nbases = n <= UINT32_MAX ? 3 : 7;
+  if(n < 2){
+    return 0;
+  }
+  for(int i = 0; i < 12; i++){
+    if(n % small[i] == 0){
+      return n == small[i];
+    }
+  }
+  if(n < 37*37){                                          // no factor up to its square root
+    return 1;
+  }
+  uint64_t d = n - 1;                                     // n-1 = d * 2^r with d odd
+  int r = 0;
+  while((d & 1) == 0){
+    d >>= 1;
+    r++;
+  }
+  for(int i = 0; i < nbases; i++){
+    uint64_t a = bases[i] % n;
+    if(a == 0){
+      continue;
+    }
+    uint64_t x = powmod64(a, d, n);
+    if(x == 1 || x == n - 1){
+      continue;
+    }
+    int composite = 1;
+    for(int j = 1; j < r; j++){
+      x = mulmod64(x, x, n);
+      if(x == n - 1){
+        composite = 0;
+        break;
+      }
+    }
+    if(composite){
+      return 0;
+    }
+  }
+  return 1;
+}
+
 // If 'num' is a prime number, returns 'num'. Otherwise, returns the
-// first prime that is larger than 'num'. Uses a simple algorithm to
-// calculate primeness: check if any number between 2 and (num/2)
-// divide num. If none do, it is prime. If not, tries next odd number
-// above num. Loops this approach until a prime number is located and
-// returns this. Used to ensure that hash table_size stays prime which
-// theoretically distributes elements better among the array indices
-// of the table.
+// first prime that is larger than 'num'. Numbers below 2 give 2.
+// Candidates are tested with is_prime64() and only odd candidates
+// above 2 are tried; prime gaps below 2^64 are a few hundred at most
+// so this answers quickly for any input. Returns 0 if there is no
+// prime between 'num' and 2^64-1.
+uint64_t next_prime64(uint64_t num){
+  if(num <= 2){
+    return 2;
+  }
+  uint64_t cand = num | 1;                                // first odd number >= num
+  while(cand >= num){                                     // stops if cand wraps past 2^64-1
+    if(is_prime64(cand)){
+      return cand;
+    }
+    cand += 2;
+  }
+  return 0;
+}
+
+// If 'num' is a prime number, returns 'num'. Otherwise, returns the
+// first prime that is larger than 'num'. Used to ensure that hash
+// table_size stays prime which theoretically distributes elements
+// better among the array indices of the table. Uses next_prime64()
+// so the answer is exact and immediate for every int; the largest int
+// is itself prime so the result always fits.
 int next_prime(int num){
-  int cur_num = num;
-  for(int i = 2; i < (cur_num/2); i++){
+  if(num <= 2){
+    return 2;
+  }
+  return (int) next_prime64(num);
+}
 
-    if(cur_num % i == 0){                               // if ... go try next i in for loop
+// Replaces the table of `hs` with one of `new_size` buckets and moves
+// all current nodes into it. After allocating the new table, all table
+// entries are initialized to 0 then the `nodes` array is walked in
+// order and each node is relinked at the FRONT of its bucket in the
+// new table using the hash code cached in the node. Walking in
+// insertion order and pushing on the front gives exactly the bucket
+// lists that re-adding every elem would. Nodes and the string arena
+// are left in place; besides the new table a byte per bucket counts
+// the chains as they are built so those that are still
+// HASHSET_SORT_CHAIN nodes long are converted again straight away.
+static void hashset_resize(hashset_t *hs, int new_size){
+  hashset_rehash_finish(hs);
+  uint32_t *new_table = calloc(new_size, sizeof(uint32_t));
+  free(hs->table);                                          // old bucket lists are rebuilt below
+  hashset_free_sorted(hs->sorted, hs->table_size);
+  hs->sorted = NULL;
+  hs->table = new_table;
+  hs->table_size = new_size;
 
-      if(cur_num % 2 == 0){                             // if cur_num is divisible by 2, recursively try next_prime with THAT number plus 1
-        return next_prime(cur_num+1);
-      }else{
-        return next_prime(cur_num+2);                   // is !divisible by 2 then recursively try with plus 2
-      }
+  unsigned char *lengths = calloc(new_size, 1);             // chain lengths up to HASHSET_SORT_CHAIN
+  for(int i = 1; i <= hs->node_count; i++){                // relink every node in insertion order
+    hashnode_t *current = &hs->nodes[i];
+    if(current->elem_len < 0){
+      continue;                                             // removed, see hashset_remove()
+    }
+    int index = hashset_bucket(hs, current->hash, hs->table_size);
+    current->table_next = hs->table[index];
+    hs->table[index] = i;
+    if(lengths != NULL && lengths[index] < HASHSET_SORT_CHAIN){
+      lengths[index]++;
     }
   }
-  return num;
+  if(lengths != NULL){                                      // no lengths means no memory to convert with either
+    hashset_sort_long_buckets(hs, lengths);
+  }
+  free(lengths);
+}
+
+// Moves the nodes of `hs` into a table of `new_size` buckets, all at
+// once or, if `rehash_step` is positive, incrementally as
+// hashset_expand() describes. Used to both grow and shrink the table.
+static void hashset_resize_to(hashset_t *hs, int new_size){
+  if(hs->rehash_step <= 0){
+    hashset_resize(hs, new_size);
+    return;
+  }
+  hashset_rehash_finish(hs);                                // one resize in flight at a time
+  hs->old_table = hs->table;
+  hs->old_sorted = hs->sorted;
+  hs->sorted = NULL;
+  hs->old_table_size = hs->table_size;
+  hs->rehash_index = 0;
+  hs->table = calloc(new_size, sizeof(uint32_t));          // zeroed lazily by the OS for big tables
+  hs->table_size = new_size;
 }
 
 // Allocates a new, larger area of memory for the `table` field and
-// re-adds all current elems to it. The size of the new table is
-// next_prime(2*table_size+1) which keeps the size prime.  After
-// allocating the new table, all table entries are initialized to NULL
-// then the old table is iterated through and all elems are added to
-// the new table according to their hash code. The memory for the old
-// table is de-allocated and the new table assigned to the hash set
-// fields "table" and "table_size".  This function increases
-// "table_size" while keeping "elem_count" the same thereby reducing
-// the load of the hash table. Ensures that the memory associated with
-// the old table is free()'d. Makes NO special effort to preserve old
-// nodes: re-adds everything into the new table and then frees the old
-// one along with its nodes. Uses functions such as hashset_init(),
-// hashset_add(), hashset_free_fields() to accomplish the transfer.
+// moves all current nodes into it. The size of the new table is
+// next_prime(2*table_size+1) which keeps the size prime, or double the
+// size in the power of two modes. Nodes are
+// relinked rather than re-added (see hashset_resize()) so the only
+// allocation is the new table; the old table is free()'d.  This
+// function increases "table_size" while keeping "elem_count" the same
+// thereby reducing the load of the hash table. If `rehash_step` is
+// positive the nodes are instead moved incrementally: the current
+// table becomes `old_table` and later adds/contains each move
+// `rehash_step` of its buckets into the new, empty table.
 void hashset_expand(hashset_t *hs){
-  hashset_t new_hash;
-  hashset_init(&new_hash, next_prime(2*hs->table_size+1));                
-  hashnode_t *current = hs->order_first;
+  hashset_resize_to(hs, hashset_grow_size(hs, hs->table_size));
+}
+
+// Sets how many old buckets each add/contains moves while an expand
+// is in progress. A positive `rehash_step` makes hashset_expand(),
+// including automatic expansion, incremental so that no single
+// operation moves more than `rehash_step` buckets. 0 or less moves all
+// nodes during the expand itself and completes any resize in
+// progress.
+void hashset_set_rehash_step(hashset_t *hs, int rehash_step){
+  hs->rehash_step = rehash_step > 0 ? rehash_step : 0;
+  if(hs->rehash_step == 0){
+    hashset_rehash_finish(hs);
+  }
+}
+
+// Moves all remaining buckets of an incremental resize in progress
+// so that every node is in `table`. Does nothing if no resize is in
+// progress.
+void hashset_rehash_finish(hashset_t *hs){
+  if(hs->old_table != NULL){
+    hashset_rehash_some(hs, hs->old_table_size);
+  }
+}
+
+// Sets the maximum load factor of `hs`. Once an addition makes
+// elem_count/table_size exceed `max_load`, hashset_add() expands the
+// table. A `max_load` of 0 or less turns automatic expansion off. If
+// the hash set is already over the new limit it is expanded right
+// away.
+void hashset_set_max_load(hashset_t *hs, double max_load){
+  hs->max_load = max_load > 0 ? max_load : 0.0;
+  while(hs->max_load > 0 && hs->elem_count > hs->max_load * hs->table_size){
+    hashset_expand(hs);
+  }
+}
+
+// Capacity hint: grows the table of `hs` in a single step so that
+// `elem_count` elements fit without exceeding `max_load`. The new
+// size is the smallest size hashset_expand() would reach that is large
+// enough so tables end up the same size as with automatic expansion.
+// Does nothing if automatic expansion is off or the table is already
+// big enough.
+void hashset_reserve(hashset_t *hs, int elem_count){
+  if(hs->max_load <= 0){
+    return;
+  }
+  int new_size = hs->table_size;
+  while(elem_count > hs->max_load * new_size){
+    new_size = hashset_grow_size(hs, new_size);
+  }
+  if(new_size != hs->table_size){
+    hashset_resize(hs, new_size);
+  }
+}
+
+// Unlinks the node for the `len` character string `elem` with hash
+// code `hc` from bucket `index` of the table with bucket heads `heads`
+// and sorted arrays `sorted` (which may be NULL) and returns its index,
+// or returns 0 if it is not in that bucket. The chain is walked with a
+// pointer to the link that leads to each node so the node found is cut
+// out with one store. A sorted array loses the node as well and is
+// dropped once it falls under half of HASHSET_SORT_CHAIN, leaving a
+// plain chain.
+static uint32_t hashset_unlink(hashset_t *hs, uint32_t *heads, hashsorted_t **sorted,
+                               int index, char elem[], int len, int hc){
+  uint32_t *link = &heads[index];
+  while(*link != 0){
+    hashnode_t *node = &hs->nodes[*link];
+    if(node->hash == hc && node->elem_len == len &&
+       memcmp(elem, hashset_elem(hs, *link), len) == 0){
+      break;
+    }
+    link = &node->table_next;
+  }
+  uint32_t n = *link;
+  if(n == 0){
+    return 0;
+  }
+  *link = hs->nodes[n].table_next;
+  if(sorted != NULL && sorted[index] != NULL){
+    hashsorted_t *sarr = sorted[index];
+    int pos = hashset_sorted_search(hs, sarr, elem, len, hc, NULL);
+    sarr->count--;
+    memmove(&sarr->nodes[pos], &sarr->nodes[pos+1], sizeof(uint32_t) * (sarr->count - pos));
+    if(sarr->count < HASHSET_SORT_CHAIN / 2){
+      free(sarr);
+      sorted[index] = NULL;
+    }
+  }
+  return n;
+}
+
+// Slides the nodes of `hs` that are still present down over the
+// removed ones, keeping their order, and copies their strings into a
+// fresh arena, then relinks every bucket with hashset_resize(). Makes
+// the `nodes` array dense again.
+static void hashset_compact(hashset_t *hs){
+  hashset_rehash_finish(hs);                    // old_table refers to nodes by index
+  strarena_t keys = {NULL, 0, 0};
+  uint32_t live = 0;
+  for(int i = 1; i <= hs->node_count; i++){
+    hashnode_t *node = &hs->nodes[i];
+    if(node->elem_len < 0){
+      continue;
+    }
+    node->elem_off = strarena_add(&keys, hs->keys.bytes + node->elem_off, node->elem_len);
+    hs->nodes[++live] = *node;
+  }
+  strarena_free(&hs->keys);
+  hs->keys = keys;
+  hs->node_count = live;
+  hashset_resize(hs, hs->table_size);
+}
+
+// Removes `elem` from the hash set and returns 1 or returns 0 if it is
+// not present. The node is unlinked from its bucket chain, of the old
+// table if an incremental resize has not moved it yet, and marked
+// removed in the `nodes` array, so ordered output skips it without
+// any other node moving. Once removed nodes outnumber those present
+// the array and string arena are compacted, which keeps the cost per
+// remove O(1) amortized. If `max_load` is set and the load factor
+// falls below max_load/HASHSET_SHRINK_DIV the table shrinks to about
+// half its size, not below HASHSET_DEFAULT_TABLE_SIZE, so that the
+// load factor is back near max_load/2.
+int hashset_remove(hashset_t *hs, char elem[]){
+  if(hs->old_table != NULL){
+    hashset_rehash_some(hs, hs->rehash_step);
+  }
+  int len = strlen(elem);
+  int hc = hashset_hash(hs, elem, len);
+  uint32_t n = hashset_unlink(hs, hs->table, hs->sorted,
+                              hashset_bucket(hs, hc, hs->table_size), elem, len, hc);
+  if(n == 0 && hs->old_table != NULL){
+    n = hashset_unlink(hs, hs->old_table, hs->old_sorted,
+                       hashset_bucket(hs, hc, hs->old_table_size), elem, len, hc);
+  }
+  if(n == 0){
+    return 0;
+  }
+  hs->nodes[n].elem_len = -1;
+  hs->elem_count--;
+  if(hs->node_count - hs->elem_count > hs->elem_count){
+    hashset_compact(hs);
+  }
+  if(hs->max_load > 0 && hs->old_table == NULL &&
+     hs->elem_count < hs->max_load / HASHSET_SHRINK_DIV * hs->table_size){
+    int new_size = hashset_shrink_size(hs, hs->table_size);
+    if(new_size >= HASHSET_DEFAULT_TABLE_SIZE){
+      hashset_resize_to(hs, new_size);
+    }
+  }
+  return 1;
+}
+
+// Type for one key of the file given to hashset_build(), as found by
+// the worker thread that parsed its chunk
+typedef struct {
+  size_t off;                   // offset of the key in the file
+  int len;                      // length of the key
+  int hash;                     // hashset_hash() of the key
+  uint32_t node;                // 0 for a repeat of an earlier key, else its node once placed
+} build_key_t;
+
+// Type for the state hashset_build() shares with its worker threads.
+// Thread t parses chunk t of the file and, between phases, hash
+// partition t; partitions are per thread so they need no locks.
+typedef struct {
+  hashset_t *hs;                // the set being built
+  char *data;                   // the whole file
+  size_t size;                  // bytes in `data`
+  int nthreads;                 // worker threads, also chunks and partitions
+  build_key_t **keys;           // per chunk: its keys in file order
+  int *key_count;               // per chunk: length of keys[t]
+  uint32_t **part;              // per chunk: indices into keys[t] grouped by partition
+  int **part_start;             // per chunk: start in part[t] of each partition, nthreads+1 entries
+  int **kept;                   // per partition, per chunk: keys of the chunk first seen in the partition
+  size_t **kept_bytes;          // per partition, per chunk: arena bytes of those keys
+  uint32_t *node_base;          // per chunk: first node of its kept keys
+  size_t *arena_base;           // per chunk: arena offset of its kept keys
+  unsigned char *lengths;       // per bucket: chain length up to HASHSET_SORT_CHAIN, NULL if not counted
+} build_t;
+
+// Type for the argument of a hashset_build() worker thread
+typedef struct {
+  build_t *b;                   // shared state
+  int id;                       // chunk and partition of this thread
+} build_arg_t;
+
+// Runs `phase` on every worker thread of `b` and waits for all of
+// them, so each phase of hashset_build() sees the whole result of the
+// one before.
+static void build_run(build_t *b, void *(*phase)(void *)){
+  pthread_t threads[b->nthreads];
+  build_arg_t args[b->nthreads];
+  for(int t = 0; t < b->nthreads; t++){
+    args[t] = (build_arg_t) {b, t};
+    pthread_create(&threads[t], NULL, phase, &args[t]);
+  }
+  for(int t = 0; t < b->nthreads; t++){
+    pthread_join(threads[t], NULL);
+  }
+}
+
+// Returns the offset of the first line of chunk `t` of `b`: the start
+// of the line holding byte t/nthreads of the way through the file, or
+// the end of the file for t == nthreads. Chunks then never split a line.
+static size_t build_chunk_start(build_t *b, int t){
+  if(t == 0){
+    return 0;
+  }
+  if(t == b->nthreads){
+    return b->size;
+  }
+  size_t pos = b->size / b->nthreads * t;
+  char *nl = memchr(b->data + pos, '\n', b->size - pos);
+  return nl == NULL ? b->size : (size_t) (nl - b->data) + 1;
+}
+
+// Sorts the `count` indices 0..count-1 into `part` grouped by the
+// partition `part_of(b, keys[i])` returns, keeping their order within
+// a partition, and sets `start` to the start of each partition.
+static void build_partition(build_t *b, build_key_t *keys, int count,
+                            int (*part_of)(build_t *, build_key_t *),
+                            uint32_t *part, int *start){
+  memset(start, 0, sizeof(int) * (b->nthreads + 1));
+  for(int i = 0; i < count; i++){
+    start[part_of(b, &keys[i]) + 1]++;
+  }
+  for(int p = 0; p < b->nthreads; p++){
+    start[p+1] += start[p];
+  }
+  int fill[b->nthreads];
+  memcpy(fill, start, sizeof(int) * b->nthreads);
+  for(int i = 0; i < count; i++){
+    part[fill[part_of(b, &keys[i])]++] = i;
+  }
+}
+
+// Returns the partition that deduplicates `key`, from its hash alone
+// so that every copy of a key lands in the same one.
+static int build_dedup_part(build_t *b, build_key_t *key){
+  return ((uint64_t) ((uint32_t) key->hash * 0x9e3779b1u) * b->nthreads) >> 32;
+}
+
+// Returns the partition that links the node of `key` into the table,
+// from its bucket so that no two partitions share a bucket.
+static int build_link_part(build_t *b, build_key_t *key){
+  return hashset_bucket(b->hs, key->hash, b->hs->table_size) % b->nthreads;
+}
 
-  while(current != NULL){                                   // while current isnt NUll, keep adding
-    hashset_add(&new_hash, current->elem);
-    current = current->order_next;
+// Phase 1: parses chunk `id` into keys, the first whitespace separated
+// word of each line, hashes them and groups them by dedup partition.
+static void *build_parse(void *arg){
+  build_t *b = ((build_arg_t *) arg)->b;
+  int id = ((build_arg_t *) arg)->id;
+  size_t pos = build_chunk_start(b, id), end = build_chunk_start(b, id + 1);
+  int cap = 1024, count = 0;
+  build_key_t *keys = malloc(sizeof(build_key_t) * cap);
+  while(pos < end){
+    while(pos < end && (b->data[pos] == ' ' || b->data[pos] == '\t')){
+      pos++;
+    }
+    size_t key_end = pos;
+    while(key_end < end && b->data[key_end] != ' ' && b->data[key_end] != '\t' &&
+          b->data[key_end] != '\r' && b->data[key_end] != '\n'){
+      key_end++;
+    }
+    if(key_end > pos){
+      if(count == cap){
+        cap *= 2;
+        keys = realloc(keys, sizeof(build_key_t) * cap);
+      }
+      int len = key_end - pos;
+      keys[count] = (build_key_t) {pos, len, hashset_hash(b->hs, b->data + pos, len), 0};
+      count++;
+    }
+    char *nl = memchr(b->data + key_end, '\n', end - key_end);
+    pos = nl == NULL ? end : (size_t) (nl - b->data) + 1;
+  }
+  b->keys[id] = keys;
+  b->key_count[id] = count;
+  b->part[id] = malloc(sizeof(uint32_t) * (count > 0 ? count : 1));
+  b->part_start[id] = malloc(sizeof(int) * (b->nthreads + 1));
+  build_partition(b, keys, count, build_dedup_part, b->part[id], b->part_start[id]);
+  return NULL;
+}
+
+// Phase 2: goes through the keys of dedup partition `id` from every
+// chunk in file order, marking the first copy of each key to be kept
+// and counting the kept keys and their bytes per chunk. Keys are
+// matched with a private open addressing table of key pointers.
+static void *build_dedup(void *arg){
+  build_t *b = ((build_arg_t *) arg)->b;
+  int id = ((build_arg_t *) arg)->id;
+  int total = 0;
+  for(int t = 0; t < b->nthreads; t++){
+    total += b->part_start[t][id+1] - b->part_start[t][id];
   }
+  int size = 2;
+  while(size < 2 * total){
+    size *= 2;
+  }
+  build_key_t **seen = calloc(size, sizeof(build_key_t *));
+  b->kept[id] = calloc(b->nthreads, sizeof(int));
+  b->kept_bytes[id] = calloc(b->nthreads, sizeof(size_t));
+  for(int t = 0; t < b->nthreads; t++){
+    for(int i = b->part_start[t][id]; i < b->part_start[t][id+1]; i++){
+      build_key_t *key = &b->keys[t][b->part[t][i]];
+      int pos = (uint32_t) key->hash & (size - 1);
+      while(seen[pos] != NULL &&
+            (seen[pos]->hash != key->hash || seen[pos]->len != key->len ||
+             memcmp(b->data + seen[pos]->off, b->data + key->off, key->len) != 0)){
+        pos = (pos + 1) & (size - 1);
+      }
+      if(seen[pos] == NULL){
+        seen[pos] = key;
+        key->node = 1;                          // kept, placed in phase 3
+        b->kept[id][t]++;
+        b->kept_bytes[id][t] += key->len + 1;
+      }
+    }
+  }
+  free(seen);
+  return NULL;
+}
+
+// Phase 3: gives the kept keys of chunk `id` their nodes, numbered on
+// from `node_base` in file order, copies them into the string arena
+// and groups the chunk's keys by link partition.
+static void *build_place(void *arg){
+  build_t *b = ((build_arg_t *) arg)->b;
+  int id = ((build_arg_t *) arg)->id;
+  hashset_t *hs = b->hs;
+  uint32_t n = b->node_base[id];
+  size_t off = b->arena_base[id];
+  for(int i = 0; i < b->key_count[id]; i++){
+    build_key_t *key = &b->keys[id][i];
+    if(key->node == 0){
+      continue;
+    }
+    hs->nodes[n] = (hashnode_t) {off, key->len, key->hash, 0};
+    memcpy(hs->keys.bytes + off, b->data + key->off, key->len);
+    hs->keys.bytes[off + key->len] = '\0';
+    off += key->len + 1;
+    key->node = n++;
+  }
+  build_partition(b, b->keys[id], b->key_count[id], build_link_part,
+                  b->part[id], b->part_start[id]);
+  return NULL;
+}
+
+// Phase 4: pushes the nodes of link partition `id` onto the front of
+// their buckets in file order, so each chain ends up as a run of
+// hashset_add() calls would leave it, and counts the chain lengths
+// of those buckets so long ones can be converted afterwards.
+static void *build_link(void *arg){
+  build_t *b = ((build_arg_t *) arg)->b;
+  int id = ((build_arg_t *) arg)->id;
+  hashset_t *hs = b->hs;
+  for(int t = 0; t < b->nthreads; t++){
+    for(int i = b->part_start[t][id]; i < b->part_start[t][id+1]; i++){
+      build_key_t *key = &b->keys[t][b->part[t][i]];
+      if(key->node == 0){
+        continue;
+      }
+      int index = hashset_bucket(hs, key->hash, hs->table_size);
+      hs->nodes[key->node].table_next = hs->table[index];
+      hs->table[index] = key->node;
+      if(b->lengths != NULL && b->lengths[index] < HASHSET_SORT_CHAIN){
+        b->lengths[index]++;                    // only this partition touches the bucket
+      }
+    }
+  }
+  return NULL;
+}
+
+// Bulk build: replaces the contents of `hs` with the keys of
+// `filename`, the first whitespace separated word of each line,
+// using `nthreads` worker threads. Ends up exactly as adding the keys
+// in file order to an empty set of the same size and settings would:
+// repeats are dropped, the nodes keep first-seen order and the table
+// is sized with hashset_reserve() for the distinct keys. The file is
+// read whole, then in four phases separated by joins:
+//
+// 1. each thread parses and hashes one chunk of lines, chunks split on
+//    line boundaries, and groups its keys by a partition of hashes
+// 2. each thread drops repeats within one partition; all copies of a
+//    key share a partition so no key is compared across threads
+// 3. with the number of distinct keys per chunk known, each thread
+//    fills the nodes and arena bytes of one chunk's kept keys, whose
+//    places follow from those counts
+// 4. each thread links the nodes of a partition of buckets into the
+//    table
+//
+// Buckets whose chains are HASHSET_SORT_CHAIN nodes long are then
+// converted to sorted arrays, as the adds would have converted them.
+// Prints an error and returns 0, leaving `hs` unchanged, if the file
+// cannot be opened, its size can't be found by seeking, as for a pipe,
+// or it can't be held in memory; otherwise returns 1.
+int hashset_build(hashset_t *hs, char *filename, int nthreads){
+  FILE *file = fopen(filename, "r");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  build_t b;
+  b.hs = hs;
+  long size_found = -1;
+  if(fseek(file, 0, SEEK_END) == 0){
+    size_found = ftell(file);
+  }
+  if(size_found < 0 || fseek(file, 0, SEEK_SET) != 0){
+    printf("ERROR: could not find the size of file '%s'\n", filename);
+    fclose(file);
+    return 0;
+  }
+  b.size = size_found;
+  b.data = malloc(b.size > 0 ? b.size : 1);
+  if(b.data == NULL){
+    printf("ERROR: file '%s' is too large to read into memory\n", filename);
+    fclose(file);
+    return 0;
+  }
+  b.size = fread(b.data, 1, b.size, file);
+  fclose(file);
+  nthreads = nthreads > 0 ? nthreads : 1;
+  b.nthreads = nthreads;
+  b.keys = malloc(sizeof(build_key_t *) * nthreads);
+  b.key_count = malloc(sizeof(int) * nthreads);
+  b.part = malloc(sizeof(uint32_t *) * nthreads);
+  b.part_start = malloc(sizeof(int *) * nthreads);
+  b.kept = malloc(sizeof(int *) * nthreads);
+  b.kept_bytes = malloc(sizeof(size_t *) * nthreads);
+  b.node_base = malloc(sizeof(uint32_t) * nthreads);
+  b.arena_base = malloc(sizeof(size_t) * nthreads);
+
+  uint64_t seed[2] = {hs->seed[0], hs->seed[1]};
+  int size = hs->table_size, hash_mode = hs->hash_mode;
+  double max_load = hs->max_load;
+  int rehash_step = hs->rehash_step;
+  hashset_free_fields(hs);
+  hashset_init_seeded(hs, size, hash_mode, seed);
+  hashset_set_max_load(hs, max_load);
+  hashset_set_rehash_step(hs, rehash_step);
+
+  build_run(&b, build_parse);
+  build_run(&b, build_dedup);
+  int count = 0;
+  size_t bytes = 0;
+  for(int t = 0; t < nthreads; t++){            // places of each chunk's nodes and strings
+    b.node_base[t] = count + 1;
+    b.arena_base[t] = bytes;
+    for(int p = 0; p < nthreads; p++){
+      count += b.kept[p][t];
+      bytes += b.kept_bytes[p][t];
+    }
+  }
+  hashset_reserve(hs, count);
+  hs->nodes_cap = count + 1 > HASHSET_MIN_NODES ? count + 1 : HASHSET_MIN_NODES;
+  hs->nodes = malloc(sizeof(hashnode_t) * hs->nodes_cap);
+  hs->node_count = count;
+  hs->keys.cap = bytes > HASHSET_KEYS_MIN_BYTES ? bytes : HASHSET_KEYS_MIN_BYTES;
+  hs->keys.bytes = malloc(hs->keys.cap);
+  hs->keys.len = bytes;
+  b.lengths = calloc(hs->table_size, 1);
+  build_run(&b, build_place);
+  build_run(&b, build_link);
+  hs->elem_count = count;
+  if(b.lengths != NULL){                        // no lengths means no memory to convert with either
+    hashset_sort_long_buckets(hs, b.lengths);
+  }
+
+  for(int t = 0; t < nthreads; t++){
+    free(b.keys[t]);
+    free(b.part[t]);
+    free(b.part_start[t]);
+    free(b.kept[t]);
+    free(b.kept_bytes[t]);
+  }
+  free(b.keys);
+  free(b.key_count);
+  free(b.part);
+  free(b.part_start);
+  free(b.kept);
+  free(b.kept_bytes);
+  free(b.node_base);
+  free(b.arena_base);
+  free(b.lengths);
+  free(b.data);
+  return 1;
+}
+
+// Adapters from the generic hashset_ops_t interface to the functions
+// above.
+static void ops_init(void *set, int table_size){ hashset_init(set, table_size); }
+static int  ops_add(void *set, char elem[]){ return hashset_add(set, elem); }
+static int  ops_contains(void *set, char elem[]){ return hashset_contains(set, elem); }
+static void ops_expand(void *set){ hashset_expand(set); }
+static void ops_set_max_load(void *set, double max_load){ hashset_set_max_load(set, max_load); }
+static void ops_free_fields(void *set){ hashset_free_fields(set); }
+static void ops_write_elems_ordered(void *set, FILE *out){ hashset_write_elems_ordered(set, out); }
+static void ops_show_structure(void *set){ hashset_show_structure(set); }
+static void ops_save(void *set, char *filename){ hashset_save(set, filename); }
+static int  ops_load(void *set, char *filename){ return hashset_load(set, filename); }
 
-  hashset_free_fields(hs);                                  // frees
-  *hs = new_hash;                                           // sets pointer to new hashset that we made
-}
\ No newline at end of file
+hashset_ops_t hashset_chained_ops = {
+  "chained", sizeof(hashset_t),
+  ops_init, ops_add, ops_contains, ops_expand, ops_set_max_load, ops_free_fields,
+  ops_write_elems_ordered, ops_show_structure, ops_save, ops_load,
+};
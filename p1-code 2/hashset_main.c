@@ -1,12 +1,114 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "hashset.h"
 
+// hash set implementations that can be chosen with -impl <name>
+hashset_ops_t *impls[] = {
+  &hashset_chained_ops,
+  &rhset_ops,
+  &swset_ops,
+  &ckset_ops,
+  &mtset_ops,
+  &rcuset_ops,
+  NULL,
+};
+
+// Initializes `hash` for `ops` with the default size: in
+// HASHSET_HASH_KEYED mode with a fresh random seed if `keyed` is set,
+// which only the chained implementation supports.
+void init_hash(hashset_ops_t *ops, void *hash, int keyed){
+  if(keyed){
+    hashset_init_mode(hash, HASHSET_DEFAULT_TABLE_SIZE, HASHSET_HASH_KEYED);
+  }else{
+    ops->init(hash, HASHSET_DEFAULT_TABLE_SIZE);
+  }
+}
+
+// Reads the next whitespace separated word of `in` into `*word`, a
+// buffer of `*cap` bytes grown with realloc() as needed, so commands
+// and elems of any length are read whole, as hashset_read_elem() does
+// for files. Returns 1 or, at the end of input before any word, EOF
+// leaving `*word` as it was.
+int read_word(FILE *in, char **word, size_t *cap){
+  int c = fgetc(in);
+  while(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'){
+    c = fgetc(in);                             // skip leading whitespace as "%s" would
+  }
+  if(c == EOF){
+    return EOF;
+  }
+  size_t len = 0;
+  while(c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '\v' && c != '\f'){
+    if(len + 1 >= *cap){
+      *cap = *cap == 0 ? 128 : *cap * 2;
+      *word = realloc(*word, *cap);
+    }
+    (*word)[len++] = c;
+    c = fgetc(in);
+  }
+  if(c != EOF){
+    ungetc(c, in);                             // leave the whitespace, as "%s" does
+  }
+  (*word)[len] = '\0';
+  return 1;
+}
+
 int main(int argc, char *argv[]){
   int echo = 0;                                // controls echoing, 0: echo off, 1: echo on
-  if(argc > 1 && strcmp("-echo",argv[1])==0) { // turn echoing on via -echo command line option
-    echo=1;
+  int keyed = 0;                               // 1: hash with a random seed via -keyed
+  char *query = NULL;                          // constant database to look words up in via -query <file>
+  hashset_ops_t *ops = impls[0];               // implementation in use, chained by default
+  for(int i=1; i<argc; i++){
+    if(strcmp("-echo",argv[i])==0) {           // turn echoing on via -echo command line option
+      echo=1;
+    }
+    else if(strcmp("-keyed",argv[i])==0) {       // seeded siphash13() via -keyed option
+      keyed=1;
+    }
+    else if(strcmp("-query",argv[i])==0 && i+1 < argc){ // query a constant database via -query <file>
+      i++;
+      query = argv[i];
+    }
+    else if(strcmp("-impl",argv[i])==0 && i+1 < argc){ // choose implementation via -impl <name>
+      i++;
+      ops = NULL;
+      for(int j=0; impls[j] != NULL; j++){
+        if(strcmp(impls[j]->name, argv[i])==0){
+          ops = impls[j];
+        }
+      }
+      if(ops == NULL){
+        printf("unknown implementation %s\n", argv[i]);
+        return 1;
+      }
+    }
+  }
+  if(keyed && ops != &hashset_chained_ops){
+    printf("-keyed needs the chained implementation\n");
+    return 1;
+  }
+
+  if(query != NULL){                           // query mode: no commands, each word read is looked up
+    cdbset_t cdb;
+    if(!cdbset_open(&cdb, query)){
+      return 1;
+    }
+    char *line = NULL;                         // whole lines so words of any length fit
+    size_t line_cap = 0;
+    while(getline(&line, &line_cap, stdin) != -1){
+      for(char *word = strtok(line, " \t\r\n"); word != NULL; word = strtok(NULL, " \t\r\n")){
+        if(cdbset_contains(&cdb, word)){
+          printf("FOUND: %s\n", word);
+        }else{
+          printf("NOT PRESENT: %s\n", word);
+        }
+      }
+    }
+    free(line);
+    cdbset_close(&cdb);
+    return 0;
   }
 
   printf("Hashset Application\n");
@@ -17,20 +119,32 @@ int main(int argc, char *argv[]){
   printf("  print            : prints all elements in the hash set in the order they were addded\n");
   printf("  structure        : prints detailed structure of the hash set\n");
   printf("  clear            : reinitializes hash set to be empty with default size\n");
-  printf("  save <file>      : writes the contents of the hash set to the given file\n");
-  printf("  load <file>      : clears the current hash set and loads the one in the given file\n");
+  printf("  save [-b] <file> : writes the contents of the hash set to the given file, -b in binary form\n");
+  printf("  load [-b] <file> : clears the current hash set and loads the one in the given file, -b if binary\n");
   printf("  next_prime <int> : if <int> is prime, prints it, otherwise finds the next prime and prints it\n");
   printf("  expand           : expands memory size of hash set to reduce its load factor\n");
+  printf("  max_load <num>   : add expands the hash set automatically past this load factor, 0 turns it off\n");
+  printf("  freeze           : builds a read-only copy of the hash set with a perfect hash for fcontains\n");
+  printf("  fcontains <elem> : like contains but looks in the frozen copy made by freeze or fload\n");
+  printf("  fsave <file>     : writes the frozen copy to the given file in binary form\n");
+  printf("  fload <file>     : replaces the frozen copy with the one in the given file\n");
+  printf("  remove <elem>    : removes the given element from the hash set, reports a missing element\n");
+  printf("  build <file>     : clears the hash set and adds the first word of each line of the file on all cores\n");
+  printf("  csave <file>     : writes the hash set to the given file as a constant database for -query\n");
   printf("  quit             : exit the program\n");
   
-  char cmd[128];
-  hashset_t hash;
+  size_t cmd_cap = 128;                        // grown by read_word() for longer words
+  char *cmd = malloc(cmd_cap);
+  void *hash = malloc(ops->set_size);          // the hash set, of the type used by ops
+  double max_load = 0.0;                       // load factor limit set by the max_load command
+  frozenset_t frozen;                          // read-only copy made by freeze, empty until then
+  frozenset_init(&frozen);
   int success;
-  hashset_init(&hash, HASHSET_DEFAULT_TABLE_SIZE);
+  init_hash(ops, hash, keyed);
 
   while(1){
     printf("HS>> ");                 // print prompt
-    success = fscanf(stdin,"%s",cmd); // read a command
+    success = read_word(stdin, &cmd, &cmd_cap); // read a command
     if(success==EOF){                 // check for end of input
       printf("\n");                   // found end of input
       break;                          // break from loop
@@ -47,11 +161,11 @@ int main(int argc, char *argv[]){
       if(echo){
         printf("structure\n");
       }
-      hashset_show_structure(&hash);
+      ops->show_structure(hash);
     }
 
     else if(strcmp("hashcode", cmd)==0 ){ // hashcode command
-      fscanf(stdin,"%s", cmd); 
+      read_word(stdin, &cmd, &cmd_cap);
       if(echo){
         printf("hashcode %s\n", cmd);
       }
@@ -62,11 +176,11 @@ int main(int argc, char *argv[]){
     // add case for "contains" command which uses the hashset_contains() function
     
     else if(strcmp("contains", cmd)==0){           // contains command
-      fscanf(stdin,"%s",cmd);                       // reads string to check      
+      read_word(stdin, &cmd, &cmd_cap);             // reads string to check      
       if(echo){
         printf("contains %s\n",cmd);
       }
-      success = hashset_contains(&hash,cmd);      // calls contain func
+      success = ops->contains(hash,cmd);              // calls contain func
       if(success == 0){                               // checks for success
         printf("NOT PRESENT\n");
       }else{
@@ -75,63 +189,175 @@ int main(int argc, char *argv[]){
     }
 
     else if(strcmp("add", cmd)==0){               // add command
-      fscanf(stdin,"%s",cmd);                       // reads string to check      
+      read_word(stdin, &cmd, &cmd_cap);             // reads string to check      
       if(echo){
         printf("add %s\n",cmd);
       }
-      success = hashset_add(&hash, cmd);           // call list function
+      success = ops->add(hash, cmd);                // call list function
       if(!success){                                 // check for success
         printf("Elem already present, no changes made\n");
+      }else if(success < 0){                        // the cuckoo set could not place it
+        printf("add failed\n");
       }
     }
     else if(strcmp("save", cmd)==0){              // save command
-      fscanf(stdin,"%s",cmd);                       // reads string to check      
+      read_word(stdin, &cmd, &cmd_cap);             // reads string to check      
+      int binary = strcmp("-b", cmd)==0;            // -b before the file name picks the binary format
+      if(binary){
+        read_word(stdin, &cmd, &cmd_cap);
+      }
       if(echo){
-        printf("save %s\n",cmd);
+        printf("save %s%s\n",binary ? "-b " : "",cmd);
+      }
+      if(!binary){
+        ops->save(hash, cmd);
+      }else if(ops != &hashset_chained_ops){         // hashset_save_binary() writes a hashset_t
+        printf("-b needs the chained implementation\n");
+      }else{
+        hashset_save_binary(hash, cmd);
       }
-      hashset_save(&hash, cmd);
     }
 
     else if(strcmp("load", cmd)==0){           // load command
-      fscanf(stdin,"%s",cmd);                       // reads string to check      
+      read_word(stdin, &cmd, &cmd_cap);             // reads string to check      
+      int binary = strcmp("-b", cmd)==0;
+      if(binary){
+        read_word(stdin, &cmd, &cmd_cap);
+      }
       if(echo){
-        printf("load %s\n",cmd);
+        printf("load %s%s\n",binary ? "-b " : "",cmd);
+      }
+      if(!binary){
+        success = ops->load(hash, cmd);            // call list function
+      }else if(ops != &hashset_chained_ops){
+        printf("-b needs the chained implementation\n");
+        success = 1;                              // nothing was attempted
+      }else{
+        success = hashset_load_binary(hash, cmd);
       }
-      success = hashset_load(&hash, cmd);        // call list function
       if(!success){                             // check for success
         printf("load failed\n");
       }
     }
 
     else if(strcmp("next_prime", cmd)==0){           // next_prime command
-      int num;
-      fscanf(stdin,"%d",&num);                       // reads string to check      
+      long long num;
+      fscanf(stdin,"%lld",&num);                     // reads number to check, any 64-bit value
       if(echo){
-        printf("next_prime %d\n",num);
+        printf("next_prime %lld\n",num);
       }
-      printf("%d\n", next_prime(num));
+      printf("%llu\n", (unsigned long long) (num < 2 ? 2 : next_prime64(num)));
     }
 
     else if( strcmp("expand", cmd)==0 ){   // expand command
       if(echo){
         printf("expand\n");
       }
-      hashset_expand(&hash);
+      ops->expand(hash);
+    }
+
+    else if( strcmp("max_load", cmd)==0 ){   // max_load command
+      fscanf(stdin,"%lf",&max_load);                 // reads load factor limit
+      if(echo){
+        printf("max_load %g\n",max_load);
+      }
+      ops->set_max_load(hash, max_load);
     }
 
     else if( strcmp("clear", cmd)==0 ){   // clear command
       if(echo){
         printf("clear\n");
       }
-      hashset_free_fields(&hash);
-      hashset_init(&hash, HASHSET_DEFAULT_TABLE_SIZE);
+      ops->free_fields(hash);
+      init_hash(ops, hash, keyed);
+      ops->set_max_load(hash, max_load);             // clearing keeps the configured threshold
+    }
+
+    else if( strcmp("freeze", cmd)==0 ){   // freeze command
+      if(echo){
+        printf("freeze\n");
+      }
+      if(ops != &hashset_chained_ops){               // hashset_freeze() reads a hashset_t
+        printf("freeze needs the chained implementation\n");
+      }else{
+        frozenset_free_fields(&frozen);
+        if(!hashset_freeze(hash, &frozen)){
+          printf("freeze failed, elements with equal hashes\n");
+        }
+      }
+    }
+
+    else if(strcmp("fcontains", cmd)==0){           // fcontains command
+      read_word(stdin, &cmd, &cmd_cap);
+      if(echo){
+        printf("fcontains %s\n",cmd);
+      }
+      if(frozenset_contains(&frozen, cmd)){
+        printf("FOUND: %s\n", cmd);
+      }else{
+        printf("NOT PRESENT\n");
+      }
+    }
+
+    else if(strcmp("fsave", cmd)==0){               // fsave command
+      read_word(stdin, &cmd, &cmd_cap);
+      if(echo){
+        printf("fsave %s\n",cmd);
+      }
+      frozenset_save(&frozen, cmd);
+    }
+
+    else if(strcmp("fload", cmd)==0){               // fload command
+      read_word(stdin, &cmd, &cmd_cap);
+      if(echo){
+        printf("fload %s\n",cmd);
+      }
+      if(!frozenset_load(&frozen, cmd)){
+        printf("load failed\n");
+      }
+    }
+
+    else if(strcmp("remove", cmd)==0){              // remove command
+      read_word(stdin, &cmd, &cmd_cap);
+      if(echo){
+        printf("remove %s\n",cmd);
+      }
+      if(ops != &hashset_chained_ops){               // only the chained set supports removal
+        printf("remove needs the chained implementation\n");
+      }else if(!hashset_remove(hash, cmd)){
+        printf("Elem not present, no changes made\n");
+      }
+    }
+
+    else if(strcmp("build", cmd)==0){               // build command
+      read_word(stdin, &cmd, &cmd_cap);
+      if(echo){
+        printf("build %s\n",cmd);
+      }
+      if(ops != &hashset_chained_ops){               // hashset_build() fills a hashset_t
+        printf("build needs the chained implementation\n");
+      }else if(!hashset_build(hash, cmd, sysconf(_SC_NPROCESSORS_ONLN))){
+        printf("build failed\n");
+      }
+    }
+
+    else if(strcmp("csave", cmd)==0){               // csave command
+      read_word(stdin, &cmd, &cmd_cap);
+      if(echo){
+        printf("csave %s\n",cmd);
+      }
+      if(ops != &hashset_chained_ops){               // hashset_save_cdb() reads a hashset_t
+        printf("csave needs the chained implementation\n");
+      }else{
+        hashset_save_cdb(hash, cmd);
+      }
     }
 
     else if( strcmp("print", cmd)==0 ){   // print command
       if(echo){
         printf("print\n");
       }
-      hashset_write_elems_ordered(&hash, stdout);
+      ops->write_elems_ordered(hash, stdout);
     }
     
     else{
@@ -141,6 +367,9 @@ int main(int argc, char *argv[]){
     }
   }  
   // end main while loop
-  hashset_free_fields(&hash);                      // clean up the list
+  ops->free_fields(hash);                          // clean up the list
+  frozenset_free_fields(&frozen);
+  free(hash);
+  free(cmd);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,240 @@
+// intset.h: "template" for hash sets of fixed-width integer keys such
+// as 32 or 64-bit IDs. INTSET_DECLARE(name, key_t) declares the type
+// name_t and its functions; INTSET_DEFINE(name, key_t) defines them
+// and goes in exactly one .c file. intset_funcs.c instantiates u32set
+// and u64set, declared at the bottom of this file.
+//
+// Keys are stored inline: each slot of an open addressing table holds
+// its key alongside the index of the key in an insertion-ordered
+// array, so a lookup hashes the integer with intset_hash() and compares
+// keys directly without touching strings. Ordered output and the save
+// format match hashset_write_elems_ordered() and hashset_save() with
+// each key written in decimal, so files move freely between these
+// sets and the string hash sets.
+
+#ifndef INTSET_H
+#define INTSET_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include "hashset.h"
+
+#define INTSET_DEFAULT_MAX_LOAD 0.75 // default load factor limit of an integer set
+#define INTSET_MAX_MAX_LOAD 0.9      // highest load factor limit an integer set accepts
+#define INTSET_MIN_KEYS 16           // initial length of the keys array of an integer set
+
+// Returns a hash of the integer `key` for an integer set: the
+// finalizer of MurmurHash3, a few multiplies and shifts after which
+// every output bit depends on every input bit, so the low bits that
+// index a power of two table are well mixed even for sequential IDs.
+static inline uint64_t intset_hash(uint64_t key){
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+// Declares the slot and set types name_slot_t and name_t for keys of
+// type `key_t` and the functions of the set.
+#define INTSET_DECLARE(name, key_t)                                          \
+  typedef struct {                                                           \
+    key_t key;                  /* the key in this slot */                   \
+    uint32_t entry;             /* 1 + index in `keys` of the key, 0 if empty */ \
+  } name##_slot_t;                                                           \
+                                                                             \
+  typedef struct {                                                           \
+    int elem_count;             /* number of keys in the set */              \
+    int table_size;             /* number of slots, a power of two */        \
+    double max_load;            /* expand once elem_count/table_size would exceed this */ \
+    name##_slot_t *slots;       /* the open addressing table */              \
+    key_t *keys;                /* keys in insertion order */                \
+    int keys_cap;               /* allocated length of `keys` */             \
+  } name##_t;                                                                \
+                                                                             \
+  void name##_init(name##_t *set, int table_size);                           \
+  int  name##_add(name##_t *set, key_t key);                                 \
+  int  name##_contains(name##_t *set, key_t key);                            \
+  void name##_expand(name##_t *set);                                         \
+  void name##_set_max_load(name##_t *set, double max_load);                  \
+  void name##_free_fields(name##_t *set);                                    \
+  void name##_write_elems_ordered(name##_t *set, FILE *out);                 \
+  void name##_save(name##_t *set, char *filename);                           \
+  int  name##_load(name##_t *set, char *filename);
+
+// Defines the functions declared by INTSET_DECLARE(name, key_t).
+//
+// name_init() makes an empty set of at least `table_size` slots,
+// rounded up to a power of two. name_add() returns 1 if it added `key`
+// and 0 if it was present, expanding first if one more key would
+// exceed `max_load`. name_contains() returns 1 if `key` is present.
+// Both probe linearly from the slot picked by the low bits of
+// intset_hash(); a probe ends at the key or at an empty slot.
+// name_expand() doubles the slots and places every key again from the
+// `keys` array. name_set_max_load() treats values of 0 or less as
+// INTSET_DEFAULT_MAX_LOAD and caps them at INTSET_MAX_MAX_LOAD as open
+// addressing can't run full. name_write_elems_ordered(), name_save()
+// and name_load() use the format of their hashset_t counterparts.
+// name_load() builds the loaded set aside and parses each element with
+// strtoull(); if one is not a whole decimal number that fits `key_t`
+// it prints an error and returns 0, leaving `set` unchanged.
+#define INTSET_DEFINE(name, key_t)                                           \
+  void name##_init(name##_t *set, int table_size){                           \
+    int size = 1;                                                            \
+    while(size < table_size){                                                \
+      size *= 2;                                                             \
+    }                                                                        \
+    set->elem_count = 0;                                                     \
+    set->table_size = size;                                                  \
+    set->max_load = INTSET_DEFAULT_MAX_LOAD;                                 \
+    set->slots = calloc(size, sizeof(name##_slot_t)); /* all slots empty */  \
+    set->keys = NULL;                                                        \
+    set->keys_cap = 0;                                                       \
+  }                                                                          \
+                                                                             \
+  static void name##_place(name##_t *set, key_t key, int entry){             \
+    int mask = set->table_size - 1;                                          \
+    int pos = intset_hash(key) & mask;                                       \
+    while(set->slots[pos].entry != 0){                                       \
+      pos = (pos + 1) & mask;                                                \
+    }                                                                        \
+    set->slots[pos].key = key;                                               \
+    set->slots[pos].entry = entry + 1;                                       \
+  }                                                                          \
+                                                                             \
+  static void name##_resize(name##_t *set, int new_size){                    \
+    free(set->slots);                                                        \
+    set->slots = calloc(new_size, sizeof(name##_slot_t));                    \
+    set->table_size = new_size;                                              \
+    for(int i = 0; i < set->elem_count; i++){                                \
+      name##_place(set, set->keys[i], i);                                    \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  void name##_expand(name##_t *set){                                         \
+    name##_resize(set, set->table_size * 2);                                 \
+  }                                                                          \
+                                                                             \
+  void name##_set_max_load(name##_t *set, double max_load){                  \
+    if(max_load <= 0){                                                       \
+      max_load = INTSET_DEFAULT_MAX_LOAD;                                    \
+    }                                                                        \
+    if(max_load > INTSET_MAX_MAX_LOAD){                                      \
+      max_load = INTSET_MAX_MAX_LOAD;                                        \
+    }                                                                        \
+    set->max_load = max_load;                                                \
+    while(set->elem_count > set->max_load * set->table_size){                \
+      name##_expand(set);                                                    \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  int name##_contains(name##_t *set, key_t key){                             \
+    int mask = set->table_size - 1;                                          \
+    int pos = intset_hash(key) & mask;                                       \
+    while(set->slots[pos].entry != 0){                                       \
+      if(set->slots[pos].key == key){                                        \
+        return 1;                                                            \
+      }                                                                      \
+      pos = (pos + 1) & mask;                                                \
+    }                                                                        \
+    return 0;                                                                \
+  }                                                                          \
+                                                                             \
+  int name##_add(name##_t *set, key_t key){                                  \
+    if(name##_contains(set, key)){                                           \
+      return 0;                                                              \
+    }                                                                        \
+    while(set->elem_count + 1 > set->max_load * set->table_size){            \
+      name##_expand(set);                                                    \
+    }                                                                        \
+    if(set->elem_count == set->keys_cap){                                    \
+      set->keys_cap = set->keys_cap == 0 ? INTSET_MIN_KEYS : set->keys_cap * 2; \
+      set->keys = realloc(set->keys, sizeof(key_t) * set->keys_cap);         \
+    }                                                                        \
+    set->keys[set->elem_count] = key;                                        \
+    name##_place(set, key, set->elem_count);                                 \
+    set->elem_count++;                                                       \
+    return 1;                                                                \
+  }                                                                          \
+                                                                             \
+  void name##_free_fields(name##_t *set){                                    \
+    free(set->slots);                                                        \
+    set->slots = NULL;                                                       \
+    free(set->keys);                                                         \
+    set->keys = NULL;                                                        \
+    set->keys_cap = 0;                                                       \
+    set->elem_count = 0;                                                     \
+    set->table_size = 0;                                                     \
+  }                                                                          \
+                                                                             \
+  void name##_write_elems_ordered(name##_t *set, FILE *out){                 \
+    for(int i = 0; i < set->elem_count; i++){                                \
+      fprintf(out, "   %d %llu\n", i+1, (unsigned long long) set->keys[i]);  \
+    }                                                                        \
+  }                                                                          \
+                                                                             \
+  void name##_save(name##_t *set, char *filename){                           \
+    FILE *file = fopen(filename, "w");                                       \
+    if(file == NULL){                                                        \
+      printf("ERROR: could not open file '%s'\n", filename);                 \
+      return;                                                                \
+    }                                                                        \
+    fprintf(file, "%d %d\n", set->table_size, set->elem_count);              \
+    name##_write_elems_ordered(set, file);                                   \
+    fclose(file);                                                            \
+  }                                                                          \
+                                                                             \
+  int name##_load(name##_t *set, char *filename){                            \
+    FILE *file = fopen(filename, "r");                                       \
+    if(file == NULL){                                                        \
+      printf("ERROR: could not open file '%s'\n", filename);                 \
+      return 0;                                                              \
+    }                                                                        \
+    int size, count;                                                         \
+    uint64_t seed[2];           /* intset_hash() takes no seed, ignored */   \
+    hashset_read_header(file, &size, &count, seed);                          \
+    name##_t loaded;                                                         \
+    name##_init(&loaded, size);                                              \
+    name##_set_max_load(&loaded, set->max_load);                             \
+    int new_size = loaded.table_size;                                        \
+    while(count > loaded.max_load * new_size){                               \
+      new_size *= 2;                                                         \
+    }                                                                        \
+    if(new_size != loaded.table_size){                                       \
+      name##_resize(&loaded, new_size);                                      \
+    }                                                                        \
+    char *line = NULL;                                                       \
+    size_t line_cap = 0;                                                     \
+    char *elem;                                                              \
+    int ok = 1;                                                              \
+    for(int i = 0; ok && i < count && hashset_read_elem(file, &line, &line_cap, &elem) >= 0; i++){ \
+      char *end;                                                             \
+      errno = 0;                                                             \
+      unsigned long long key = strtoull(elem, &end, 10);                     \
+      ok = elem[0] >= '0' && elem[0] <= '9' && *end == '\0' &&               \
+        errno == 0 && key <= (key_t) -1; /* (key_t) -1 is the largest key */ \
+      if(ok){                                                                \
+        name##_add(&loaded, (key_t) key);                                    \
+      }else{                                                                 \
+        printf("ERROR: '%s' in file '%s' is not a valid key\n", elem, filename); \
+      }                                                                      \
+    }                                                                        \
+    free(line);                                                              \
+    fclose(file);                                                            \
+    if(!ok){                                                                 \
+      name##_free_fields(&loaded);                                           \
+      return 0;                                                              \
+    }                                                                        \
+    name##_free_fields(set);                                                 \
+    *set = loaded;                                                           \
+    return 1;                                                                \
+  }
+
+// sets instantiated in intset_funcs.c
+INTSET_DECLARE(u32set, uint32_t)
+INTSET_DECLARE(u64set, uint64_t)
+
+#endif
@@ -0,0 +1,12 @@
+// intset_funcs.c: the integer key hash sets declared in intset.h,
+// instantiated from the INTSET_DEFINE() template for 32 and 64-bit
+// unsigned keys.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include "intset.h"
+
+INTSET_DEFINE(u32set, uint32_t)
+INTSET_DEFINE(u64set, uint64_t)
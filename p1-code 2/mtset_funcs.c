@@ -0,0 +1,325 @@
+// mtset_funcs.c: a chained hash set that many threads may use at once.
+// Provides the same operations as the chained hash set in
+// hashset_funcs.c so hashset_main can run it too. Rather than one lock
+// around the whole set, buckets are guarded by a table of striped
+// reader/writer locks: lookups in different buckets never wait for
+// each other and an add only excludes the buckets sharing its lock.
+// Because the table size is a power of two and never smaller than the
+// number of locks in use, the lock of an element depends only on the
+// low bits of its hash, so it stays the same across expands. An
+// expand takes every lock, which waits out all lookups and adds in
+// progress. Init, free, load and max_load changes are not thread-safe
+// and must happen while no other thread uses the set.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "hashset.h"
+
+// Initialize the locked set `mt` to have at least `table_size`
+// buckets, rounded up to a power of two, and no elements. Automatic
+// expansion is off until a maximum load factor is set with
+// mtset_set_max_load(), as for hashset_init().
+void mtset_init(mtset_t *mt, int table_size){
+  int size = 1;
+  while(size < table_size){
+    size *= 2;
+  }
+  mt->elem_count = 0;
+  mt->table_size = size;
+  mt->max_load = 0.0;
+  mt->table = calloc(size, sizeof(mtnode_t *));   // all buckets empty
+  mt->stripe_mask = (size < MTSET_STRIPES ? size : MTSET_STRIPES) - 1;
+  mt->stripes = aligned_alloc(sizeof(mtstripe_t), sizeof(mtstripe_t) * MTSET_STRIPES);
+  for(int i = 0; i < MTSET_STRIPES; i++){
+    pthread_rwlock_init(&mt->stripes[i].lock, NULL);
+  }
+  pthread_mutex_init(&mt->order_lock, NULL);
+  mt->order_first = NULL;
+  mt->order_last = NULL;
+}
+
+// Returns the hash of the `len` character string `elem` cached in the
+// nodes of a locked set: the low 32 bits of hashcode64().
+static uint32_t mtset_hash(char elem[], int len){
+  return (uint32_t) hashcode64(elem, len);
+}
+
+// Locks the stripe guarding the bucket of hash `hash`, for writing if
+// `write` is set and otherwise for reading, and returns it. The lock
+// count is read before the lock is taken, so an expand that raised it
+// meanwhile may have moved the bucket under another lock; then the
+// lock is released and the right one taken.
+static mtstripe_t *mtset_lock(mtset_t *mt, uint32_t hash, int write){
+  while(1){
+    int mask = __atomic_load_n(&mt->stripe_mask, __ATOMIC_RELAXED);
+    mtstripe_t *stripe = &mt->stripes[hash & mask];
+    if(write){
+      pthread_rwlock_wrlock(&stripe->lock);
+    }else{
+      pthread_rwlock_rdlock(&stripe->lock);
+    }
+    if(mt->stripe_mask == mask){
+      return stripe;
+    }
+    pthread_rwlock_unlock(&stripe->lock);
+  }
+}
+
+// Takes every lock of `mt`, for writing if `write` is set, in order
+// so that two threads doing so can't deadlock. With all of them held
+// no other thread is inside any bucket.
+static void mtset_lock_all(mtset_t *mt, int write){
+  for(int i = 0; i < MTSET_STRIPES; i++){
+    if(write){
+      pthread_rwlock_wrlock(&mt->stripes[i].lock);
+    }else{
+      pthread_rwlock_rdlock(&mt->stripes[i].lock);
+    }
+  }
+}
+
+// Releases the locks taken by mtset_lock_all().
+static void mtset_unlock_all(mtset_t *mt){
+  for(int i = MTSET_STRIPES - 1; i >= 0; i--){
+    pthread_rwlock_unlock(&mt->stripes[i].lock);
+  }
+}
+
+// Returns the node for the `len` character string `elem` with hash
+// `hash` or NULL if it is not present. The caller holds the lock of
+// its bucket.
+static mtnode_t *mtset_find(mtset_t *mt, char elem[], int len, uint32_t hash){
+  mtnode_t *node = mt->table[hash & (mt->table_size - 1)];
+  while(node != NULL){
+    if(node->hash == hash && node->elem_len == len && memcmp(node->elem, elem, len) == 0){
+      return node;
+    }
+    node = node->table_next;
+  }
+  return NULL;
+}
+
+// Replaces the table of `mt` with one of `new_size` buckets, moving
+// every node to its new bucket, and raises the lock count along with
+// the size. The caller holds every lock for writing.
+static void mtset_resize(mtset_t *mt, int new_size){
+  mtnode_t **table = calloc(new_size, sizeof(mtnode_t *));
+  for(int i = 0; i < mt->table_size; i++){
+    mtnode_t *node = mt->table[i];
+    while(node != NULL){
+      mtnode_t *next = node->table_next;
+      int index = node->hash & (new_size - 1);
+      node->table_next = table[index];
+      table[index] = node;
+      node = next;
+    }
+  }
+  free(mt->table);
+  mt->table = table;
+  mt->table_size = new_size;
+  int mask = (new_size < MTSET_STRIPES ? new_size : MTSET_STRIPES) - 1;
+  __atomic_store_n(&mt->stripe_mask, mask, __ATOMIC_RELAXED);
+}
+
+// Doubles the number of buckets of `mt`. Safe to call while other
+// threads use the set; it waits for every lookup and add in progress
+// to finish and holds off new ones until done.
+void mtset_expand(mtset_t *mt){
+  mtset_lock_all(mt, 1);
+  mtset_resize(mt, mt->table_size * 2);
+  mtset_unlock_all(mt);
+}
+
+// Sets the load factor past which mtset_add() expands `mt`; 0 or less
+// never expands. Expands right away if `mt` is already over the limit.
+void mtset_set_max_load(mtset_t *mt, double max_load){
+  mt->max_load = max_load > 0 ? max_load : 0.0;
+  while(mt->max_load > 0 && mt->elem_count > mt->max_load * mt->table_size){
+    mtset_expand(mt);
+  }
+}
+
+// Returns 1 if `elem` is in `mt` and 0 otherwise. Holds the lock of
+// its bucket for reading, so lookups run alongside each other.
+int mtset_contains(mtset_t *mt, char elem[]){
+  int len = strlen(elem);
+  uint32_t hash = mtset_hash(elem, len);
+  mtstripe_t *stripe = mtset_lock(mt, hash, 0);
+  int found = mtset_find(mt, elem, len, hash) != NULL;
+  pthread_rwlock_unlock(&stripe->lock);
+  return found;
+}
+
+// Adds `elem` to `mt` and returns 1 or returns 0 if it is already
+// present. Holds the lock of its bucket for writing while checking for
+// it and pushing its node on the front of the bucket. The node is
+// appended to the insertion order under `order_lock` before the bucket
+// lock is released, so the order is exactly that in which adds took
+// effect. If the addition pushes the load factor past `max_load` the
+// set is expanded once every lock can be taken, unless another thread
+// expanded it first.
+int mtset_add(mtset_t *mt, char elem[]){
+  int len = strlen(elem);
+  uint32_t hash = mtset_hash(elem, len);
+  mtstripe_t *stripe = mtset_lock(mt, hash, 1);
+  if(mtset_find(mt, elem, len, hash) != NULL){
+    pthread_rwlock_unlock(&stripe->lock);
+    return 0;
+  }
+  mtnode_t *node = malloc(sizeof(mtnode_t) + len + 1);
+  node->hash = hash;
+  node->elem_len = len;
+  memcpy(node->elem, elem, len + 1);
+  node->order_next = NULL;
+  int index = hash & (mt->table_size - 1);
+  node->table_next = mt->table[index];
+  mt->table[index] = node;
+  pthread_mutex_lock(&mt->order_lock);
+  if(mt->order_last == NULL){
+    mt->order_first = node;
+  }else{
+    mt->order_last->order_next = node;
+  }
+  mt->order_last = node;
+  int count = ++mt->elem_count;
+  pthread_mutex_unlock(&mt->order_lock);
+  int table_size = mt->table_size;
+  pthread_rwlock_unlock(&stripe->lock);
+  if(mt->max_load > 0 && count > mt->max_load * table_size){
+    mtset_lock_all(mt, 1);
+    if(mt->elem_count > mt->max_load * mt->table_size){
+      mtset_resize(mt, mt->table_size * 2);
+    }
+    mtset_unlock_all(mt);
+  }
+  return 1;
+}
+
+// De-allocates the nodes, table and locks of `mt` and sets its fields
+// to indicate it has no usable space. Does NOT free `mt` itself.
+void mtset_free_fields(mtset_t *mt){
+  mtnode_t *node = mt->order_first;
+  while(node != NULL){
+    mtnode_t *next = node->order_next;
+    free(node);
+    node = next;
+  }
+  mt->order_first = NULL;
+  mt->order_last = NULL;
+  free(mt->table);
+  mt->table = NULL;
+  for(int i = 0; i < MTSET_STRIPES; i++){
+    pthread_rwlock_destroy(&mt->stripes[i].lock);
+  }
+  free(mt->stripes);
+  mt->stripes = NULL;
+  pthread_mutex_destroy(&mt->order_lock);
+  mt->elem_count = 0;
+  mt->table_size = 0;
+}
+
+// Outputs all elements of `mt` in the order they were added, each on
+// its own line preceded by its add position, in the same format as
+// hashset_write_elems_ordered(). Holds `order_lock` so adds made
+// meanwhile wait rather than appear partway through.
+void mtset_write_elems_ordered(mtset_t *mt, FILE *out){
+  pthread_mutex_lock(&mt->order_lock);
+  int i = 1;
+  for(mtnode_t *node = mt->order_first; node != NULL; node = node->order_next){
+    fprintf(out, "   %d %s\n", i, node->elem);
+    i++;
+  }
+  pthread_mutex_unlock(&mt->order_lock);
+}
+
+// Displays detailed structure of `mt` in the format of
+// hashset_show_structure(): the stats then each bucket with its nodes
+// as {hash elem >>elem added next}. Holds every lock for reading so
+// the set doesn't change while it is shown.
+void mtset_show_structure(mtset_t *mt){
+  mtset_lock_all(mt, 0);
+  printf("elem_count: %d\n", mt->elem_count);
+  printf("table_size: %d\n", mt->table_size);
+  printf("order_first: %s\n", mt->order_first == NULL ? "NULL" : mt->order_first->elem);
+  printf("order_last : %s\n", mt->order_last == NULL ? "NULL" : mt->order_last->elem);
+  printf("load_factor: %.4f\n", (double) mt->elem_count / mt->table_size);
+  for(int i = 0; i < mt->table_size; i++){
+    printf("[%2d] :", i);
+    for(mtnode_t *node = mt->table[i]; node != NULL; node = node->table_next){
+      printf(" {%d %s >>%s}", (int) node->hash, node->elem,
+             node->order_next == NULL ? "NULL" : node->order_next->elem);
+    }
+    printf("\n");
+  }
+  mtset_unlock_all(mt);
+}
+
+// Writes `mt` to `filename` in the format of hashset_save() so the
+// files of either implementation can be loaded by the other.
+void mtset_save(mtset_t *mt, char *filename){
+  FILE *file = fopen(filename, "w");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  fprintf(file, "%d %d\n", mt->table_size, mt->elem_count);
+  mtset_write_elems_ordered(mt, file);
+  fclose(file);
+}
+
+// Loads a file written by mtset_save() or hashset_save() into `mt`,
+// replacing its contents. Prints an error and returns 0 if the file
+// cannot be opened, otherwise returns 1. If a `max_load` is set, which
+// is kept, the table is sized up front to hold every element under it.
+int mtset_load(mtset_t *mt, char *filename){
+  FILE *file = fopen(filename, "r");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  int size, count;
+  uint64_t seed[2];                             // hashcode64() takes no seed, ignored
+  hashset_read_header(file, &size, &count, seed);
+  double max_load = mt->max_load;
+  mtset_free_fields(mt);
+  mtset_init(mt, size);
+  mtset_set_max_load(mt, max_load);
+  int new_size = mt->table_size;
+  while(mt->max_load > 0 && count > mt->max_load * new_size){
+    new_size *= 2;
+  }
+  if(new_size != mt->table_size){
+    mtset_resize(mt, new_size);
+  }
+  char *line = NULL;
+  size_t line_cap = 0;
+  char *elem;
+  for(int i = 0; i < count && hashset_read_elem(file, &line, &line_cap, &elem) >= 0; i++){
+    mtset_add(mt, elem);
+  }
+  free(line);
+  fclose(file);
+  return 1;
+}
+
+// Adapters from the generic hashset_ops_t interface to the functions
+// above.
+static void ops_init(void *set, int table_size){ mtset_init(set, table_size); }
+static int  ops_add(void *set, char elem[]){ return mtset_add(set, elem); }
+static int  ops_contains(void *set, char elem[]){ return mtset_contains(set, elem); }
+static void ops_expand(void *set){ mtset_expand(set); }
+static void ops_set_max_load(void *set, double max_load){ mtset_set_max_load(set, max_load); }
+static void ops_free_fields(void *set){ mtset_free_fields(set); }
+static void ops_write_elems_ordered(void *set, FILE *out){ mtset_write_elems_ordered(set, out); }
+static void ops_show_structure(void *set){ mtset_show_structure(set); }
+static void ops_save(void *set, char *filename){ mtset_save(set, filename); }
+static int  ops_load(void *set, char *filename){ return mtset_load(set, filename); }
+
+hashset_ops_t mtset_ops = {
+  "locked", sizeof(mtset_t),
+  ops_init, ops_add, ops_contains, ops_expand, ops_set_max_load, ops_free_fields,
+  ops_write_elems_ordered, ops_show_structure, ops_save, ops_load,
+};
@@ -0,0 +1,456 @@
+// rcuset_funcs.c: a hash set whose readers never wait. Lookups take
+// no lock at all: a reader marks a critical section with the epoch it
+// entered in and inside it follows whatever table and nodes it loads.
+// One writer at a time adds, removes and expands under a mutex, and
+// never changes anything a reader may be looking at. A new node is
+// filled in before a release store puts it in an empty slot; an
+// expand builds a whole new table and publishes it with a release
+// store. What the writer stops using, the old table after an expand or
+// the node of a removed element, is retired rather than freed.
+//
+// Epochs tell when retired memory is safe to free. The writer advances
+// the global epoch once every reader inside a critical section has
+// entered in the current one. Anything retired in epoch E was
+// reachable only to readers that entered in E or before, so once the
+// global epoch reaches E+2 all of them have left and it is freed.
+//
+// The table uses open addressing with linear probing over node
+// pointers so that an expand moves pointers rather than relinking
+// nodes readers may be walking. Removal leaves RCUSET_REMOVED in the
+// slot so later probes still continue past it; expands drop them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "hashset.h"
+
+// Returns a new table of `size` empty slots.
+static rcutable_t *rcuset_table_new(int size){
+  rcutable_t *table = calloc(1, sizeof(rcutable_t) + sizeof(rcunode_t *) * size);
+  table->size = size;
+  return table;
+}
+
+// Initialize the RCU set `rs` to have at least `table_size` slots,
+// rounded up to a power of two and no fewer than
+// RCUSET_MIN_TABLE_SIZE, and no elements or readers. The maximum load
+// factor starts at RCUSET_DEFAULT_MAX_LOAD.
+void rcuset_init(rcuset_t *rs, int table_size){
+  int size = RCUSET_MIN_TABLE_SIZE;
+  while(size < table_size){
+    size *= 2;
+  }
+  rs->elem_count = 0;
+  rs->used = 0;
+  rs->max_load = RCUSET_DEFAULT_MAX_LOAD;
+  rs->table = rcuset_table_new(size);
+  pthread_mutex_init(&rs->write_lock, NULL);
+  rs->epoch = 1;
+  rs->readers = aligned_alloc(sizeof(rcureader_t), sizeof(rcureader_t) * RCUSET_MAX_READERS);
+  memset(rs->readers, 0, sizeof(rcureader_t) * RCUSET_MAX_READERS);
+  rs->reader_count = 0;
+  rs->retired = NULL;
+  rs->order_first = NULL;
+  rs->order_last = NULL;
+}
+
+// Registers a reader thread of `rs` and returns its number for
+// rcuset_read_lock() and rcuset_read_unlock(), or -1 if
+// RCUSET_MAX_READERS are already registered. Each reader thread
+// registers once and only it uses its number.
+int rcuset_reader(rcuset_t *rs){
+  int reader = __atomic_fetch_add(&rs->reader_count, 1, __ATOMIC_SEQ_CST);
+  if(reader >= RCUSET_MAX_READERS){
+    __atomic_fetch_sub(&rs->reader_count, 1, __ATOMIC_SEQ_CST);
+    return -1;
+  }
+  return reader;
+}
+
+// Enters a read critical section of `reader`, inside which it may call
+// rcuset_contains() and nothing it reaches is freed. Records the
+// global epoch as the reader's, then checks the epoch didn't advance
+// before the record became visible; if it did the writer may not have
+// seen the reader, so it records the new epoch and checks again. Never
+// waits for the writer.
+void rcuset_read_lock(rcuset_t *rs, int reader){
+  uint64_t epoch = __atomic_load_n(&rs->epoch, __ATOMIC_SEQ_CST);
+  while(1){
+    __atomic_store_n(&rs->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    uint64_t now = __atomic_load_n(&rs->epoch, __ATOMIC_SEQ_CST);
+    if(now == epoch){
+      return;
+    }
+    epoch = now;
+  }
+}
+
+// Leaves the read critical section of `reader`. Nodes and tables it
+// looked at may be freed from now on.
+void rcuset_read_unlock(rcuset_t *rs, int reader){
+  __atomic_store_n(&rs->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+// Returns 1 if `elem` is in `rs` and 0 otherwise. Takes no lock: loads
+// the current table and each slot it probes with acquire loads, so any
+// node it finds was fully filled in, and stops at an empty slot. Must
+// be called inside a read critical section or by a thread that is the
+// only one using `rs`, such as hashset_main.
+int rcuset_contains(rcuset_t *rs, char elem[]){
+  int len = strlen(elem);
+  uint32_t hash = (uint32_t) hashcode64(elem, len);
+  rcutable_t *table = __atomic_load_n(&rs->table, __ATOMIC_ACQUIRE);
+  int mask = table->size - 1;
+  for(int pos = hash & mask; ; pos = (pos + 1) & mask){
+    rcunode_t *node = __atomic_load_n(&table->slots[pos], __ATOMIC_ACQUIRE);
+    if(node == NULL){
+      return 0;
+    }
+    if(node != RCUSET_REMOVED && node->hash == hash && node->elem_len == len &&
+       memcmp(node->elem, elem, len) == 0){
+      return 1;
+    }
+  }
+}
+
+// Returns the slot of the current table holding the node for the
+// `len` character string `elem` with hash `hash` or -1 if it is not
+// present. Only the writer calls this so slots are read plainly.
+static int rcuset_find(rcuset_t *rs, char elem[], int len, uint32_t hash){
+  rcutable_t *table = rs->table;
+  int mask = table->size - 1;
+  for(int pos = hash & mask; table->slots[pos] != NULL; pos = (pos + 1) & mask){
+    rcunode_t *node = table->slots[pos];
+    if(node != RCUSET_REMOVED && node->hash == hash && node->elem_len == len &&
+       memcmp(node->elem, elem, len) == 0){
+      return pos;
+    }
+  }
+  return -1;
+}
+
+// Tries to advance the global epoch of `rs`, which succeeds if every
+// reader in a critical section entered in the current epoch, then
+// frees whatever was retired at least 2 epochs ago. Retired items are
+// kept newest first so those old enough form the tail of the list.
+// Called by the writer.
+static void rcuset_reclaim(rcuset_t *rs){
+  uint64_t epoch = rs->epoch;
+  int readers = __atomic_load_n(&rs->reader_count, __ATOMIC_SEQ_CST);
+  int advance = 1;
+  for(int i = 0; i < readers && advance; i++){
+    uint64_t reader_epoch = __atomic_load_n(&rs->readers[i].epoch, __ATOMIC_SEQ_CST);
+    if(reader_epoch != 0 && reader_epoch != epoch){
+      advance = 0;                              // a reader from an earlier epoch is still inside
+    }
+  }
+  if(advance){
+    epoch++;
+    __atomic_store_n(&rs->epoch, epoch, __ATOMIC_SEQ_CST);
+  }
+  rcuretired_t **link = &rs->retired;
+  while(*link != NULL && (*link)->epoch + 2 > epoch){
+    link = &(*link)->next;
+  }
+  rcuretired_t *old = *link;
+  *link = NULL;
+  while(old != NULL){
+    rcuretired_t *next = old->next;
+    free(old->ptr);
+    free(old);
+    old = next;
+  }
+}
+
+// Retires `ptr`, a table or node of `rs` the writer no longer uses,
+// to be freed by rcuset_reclaim() once no reader can hold it.
+static void rcuset_retire(rcuset_t *rs, void *ptr){
+  rcuretired_t *retired = malloc(sizeof(rcuretired_t));
+  retired->ptr = ptr;
+  retired->epoch = rs->epoch;
+  retired->next = rs->retired;
+  rs->retired = retired;
+  rcuset_reclaim(rs);
+}
+
+// Returns the number of tables and nodes of `rs` retired but not yet
+// freed. Called by the writer or while no other thread uses `rs`.
+int rcuset_retired_count(rcuset_t *rs){
+  int count = 0;
+  for(rcuretired_t *retired = rs->retired; retired != NULL; retired = retired->next){
+    count++;
+  }
+  return count;
+}
+
+// Builds a table of `new_size` slots holding every node of the current
+// table of `rs` but none of its RCUSET_REMOVED slots, publishes it and
+// retires the old one. Readers already probing the old table finish
+// there. The caller holds `write_lock`.
+static void rcuset_resize(rcuset_t *rs, int new_size){
+  rcutable_t *old = rs->table;
+  rcutable_t *table = rcuset_table_new(new_size);
+  int mask = new_size - 1;
+  for(int i = 0; i < old->size; i++){
+    rcunode_t *node = old->slots[i];
+    if(node == NULL || node == RCUSET_REMOVED){
+      continue;
+    }
+    int pos = node->hash & mask;
+    while(table->slots[pos] != NULL){
+      pos = (pos + 1) & mask;
+    }
+    table->slots[pos] = node;
+  }
+  __atomic_store_n(&rs->table, table, __ATOMIC_RELEASE);
+  rs->used = rs->elem_count;
+  rcuset_retire(rs, old);
+}
+
+// Doubles the number of slots of `rs`. Readers are not held up; they
+// keep using the old table until they next load it.
+void rcuset_expand(rcuset_t *rs){
+  pthread_mutex_lock(&rs->write_lock);
+  rcuset_resize(rs, rs->table->size * 2);
+  pthread_mutex_unlock(&rs->write_lock);
+}
+
+// Sets the load factor past which rcuset_add() expands `rs`, counting
+// removed slots as used. Open addressing needs free slots so values of
+// 0 or less select RCUSET_DEFAULT_MAX_LOAD and values above
+// RCUSET_MAX_MAX_LOAD are capped. Expands right away if `rs` is already
+// over the new limit.
+void rcuset_set_max_load(rcuset_t *rs, double max_load){
+  if(max_load <= 0){
+    max_load = RCUSET_DEFAULT_MAX_LOAD;
+  }
+  if(max_load > RCUSET_MAX_MAX_LOAD){
+    max_load = RCUSET_MAX_MAX_LOAD;
+  }
+  pthread_mutex_lock(&rs->write_lock);
+  rs->max_load = max_load;
+  while(rs->used > rs->max_load * rs->table->size){
+    rcuset_resize(rs, rs->table->size * 2);
+  }
+  pthread_mutex_unlock(&rs->write_lock);
+}
+
+// Adds `elem` to `rs` and returns 1 or returns 0 if it is already
+// present. If one more used slot would exceed `max_load` the table is
+// first rebuilt: at the same size if removed slots make up most of the
+// limit, otherwise at double. The new node is filled in and appended
+// to the insertion order, which only the writer reads, before a
+// release store publishes it in the first empty slot of its probe.
+int rcuset_add(rcuset_t *rs, char elem[]){
+  int len = strlen(elem);
+  uint32_t hash = (uint32_t) hashcode64(elem, len);
+  pthread_mutex_lock(&rs->write_lock);
+  if(rcuset_find(rs, elem, len, hash) >= 0){
+    pthread_mutex_unlock(&rs->write_lock);
+    return 0;
+  }
+  if(rs->used + 1 > rs->max_load * rs->table->size){
+    int new_size = rs->table->size;
+    if(rs->elem_count + 1 > rs->max_load * new_size / 2){
+      new_size *= 2;
+    }
+    rcuset_resize(rs, new_size);
+  }
+  rcunode_t *node = malloc(sizeof(rcunode_t) + len + 1);
+  node->hash = hash;
+  node->elem_len = len;
+  memcpy(node->elem, elem, len + 1);
+  node->order_next = NULL;
+  node->order_prev = rs->order_last;
+  if(rs->order_last == NULL){
+    rs->order_first = node;
+  }else{
+    rs->order_last->order_next = node;
+  }
+  rs->order_last = node;
+  rcutable_t *table = rs->table;
+  int mask = table->size - 1;
+  int pos = hash & mask;
+  while(table->slots[pos] != NULL){
+    pos = (pos + 1) & mask;
+  }
+  __atomic_store_n(&table->slots[pos], node, __ATOMIC_RELEASE);
+  rs->elem_count++;
+  rs->used++;
+  pthread_mutex_unlock(&rs->write_lock);
+  return 1;
+}
+
+// Removes `elem` from `rs` and returns 1 or returns 0 if it is not
+// present. Its slot becomes RCUSET_REMOVED, the node leaves the
+// insertion order and is retired, so a reader that already loaded it
+// can still compare against it.
+int rcuset_remove(rcuset_t *rs, char elem[]){
+  int len = strlen(elem);
+  uint32_t hash = (uint32_t) hashcode64(elem, len);
+  pthread_mutex_lock(&rs->write_lock);
+  int pos = rcuset_find(rs, elem, len, hash);
+  if(pos < 0){
+    pthread_mutex_unlock(&rs->write_lock);
+    return 0;
+  }
+  rcunode_t *node = rs->table->slots[pos];
+  __atomic_store_n(&rs->table->slots[pos], RCUSET_REMOVED, __ATOMIC_RELEASE);
+  if(node->order_prev == NULL){
+    rs->order_first = node->order_next;
+  }else{
+    node->order_prev->order_next = node->order_next;
+  }
+  if(node->order_next == NULL){
+    rs->order_last = node->order_prev;
+  }else{
+    node->order_next->order_prev = node->order_prev;
+  }
+  rs->elem_count--;
+  rcuset_retire(rs, node);
+  pthread_mutex_unlock(&rs->write_lock);
+  return 1;
+}
+
+// De-allocates the table, nodes, retired items and reader records of
+// `rs` and sets its fields to indicate it has no usable space. Does
+// NOT free `rs` itself. No reader may be in a critical section.
+void rcuset_free_fields(rcuset_t *rs){
+  while(rs->retired != NULL){
+    rcuretired_t *next = rs->retired->next;
+    free(rs->retired->ptr);
+    free(rs->retired);
+    rs->retired = next;
+  }
+  rcunode_t *node = rs->order_first;
+  while(node != NULL){
+    rcunode_t *next = node->order_next;
+    free(node);
+    node = next;
+  }
+  rs->order_first = NULL;
+  rs->order_last = NULL;
+  free(rs->table);
+  rs->table = NULL;
+  free(rs->readers);
+  rs->readers = NULL;
+  rs->reader_count = 0;
+  pthread_mutex_destroy(&rs->write_lock);
+  rs->elem_count = 0;
+  rs->used = 0;
+}
+
+// Outputs all elements of `rs` in the order they were added, each on
+// its own line preceded by its position, in the same format as
+// hashset_write_elems_ordered(). Holds `write_lock` as the insertion
+// order belongs to the writer.
+void rcuset_write_elems_ordered(rcuset_t *rs, FILE *out){
+  pthread_mutex_lock(&rs->write_lock);
+  int i = 1;
+  for(rcunode_t *node = rs->order_first; node != NULL; node = node->order_next){
+    fprintf(out, "   %d %s\n", i, node->elem);
+    i++;
+  }
+  pthread_mutex_unlock(&rs->write_lock);
+}
+
+// Displays detailed structure of `rs`: the same stats as
+// hashset_show_structure(), the global epoch and count of retired
+// items, then one line per slot showing the hash and element of its
+// node or that its node was removed:
+//
+// [ 5] : {-1491587362 Summer}
+// [ 6] : removed
+void rcuset_show_structure(rcuset_t *rs){
+  pthread_mutex_lock(&rs->write_lock);
+  rcutable_t *table = rs->table;
+  printf("elem_count: %d\n", rs->elem_count);
+  printf("table_size: %d\n", table->size);
+  printf("order_first: %s\n", rs->order_first == NULL ? "NULL" : rs->order_first->elem);
+  printf("order_last : %s\n", rs->order_last == NULL ? "NULL" : rs->order_last->elem);
+  printf("load_factor: %.4f\n", (double) rs->elem_count / table->size);
+  printf("epoch: %llu, retired: %d\n", (unsigned long long) rs->epoch, rcuset_retired_count(rs));
+  for(int i = 0; i < table->size; i++){
+    rcunode_t *node = table->slots[i];
+    if(node == NULL){
+      printf("[%2d] :\n", i);
+    }else if(node == RCUSET_REMOVED){
+      printf("[%2d] : removed\n", i);
+    }else{
+      printf("[%2d] : {%d %s}\n", i, (int) node->hash, node->elem);
+    }
+  }
+  pthread_mutex_unlock(&rs->write_lock);
+}
+
+// Writes `rs` to `filename` in the format of hashset_save() so the
+// files of either implementation can be loaded by the other.
+void rcuset_save(rcuset_t *rs, char *filename){
+  FILE *file = fopen(filename, "w");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  fprintf(file, "%d %d\n", rs->table->size, rs->elem_count);
+  rcuset_write_elems_ordered(rs, file);
+  fclose(file);
+}
+
+// Loads a file written by rcuset_save() or hashset_save() into `rs`,
+// replacing its contents. Prints an error and returns 0 if the file
+// cannot be opened, otherwise returns 1. The table is sized up front
+// from the header to hold every element under the current `max_load`,
+// which is kept. Not safe while other threads use `rs`.
+int rcuset_load(rcuset_t *rs, char *filename){
+  FILE *file = fopen(filename, "r");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  int size, count;
+  uint64_t seed[2];                             // hashcode64() takes no seed, ignored
+  hashset_read_header(file, &size, &count, seed);
+  double max_load = rs->max_load;
+  rcuset_free_fields(rs);
+  rcuset_init(rs, size);
+  rcuset_set_max_load(rs, max_load);
+  int new_size = rs->table->size;
+  while(count > rs->max_load * new_size){
+    new_size *= 2;
+  }
+  if(new_size != rs->table->size){
+    free(rs->table);                            // empty and never seen by a reader
+    rs->table = rcuset_table_new(new_size);
+  }
+  char *line = NULL;
+  size_t line_cap = 0;
+  char *elem;
+  for(int i = 0; i < count && hashset_read_elem(file, &line, &line_cap, &elem) >= 0; i++){
+    rcuset_add(rs, elem);
+  }
+  free(line);
+  fclose(file);
+  return 1;
+}
+
+// Adapters from the generic hashset_ops_t interface to the functions
+// above. hashset_main runs a single thread, which as the only user of
+// the set may look up without a read critical section.
+static void ops_init(void *set, int table_size){ rcuset_init(set, table_size); }
+static int  ops_add(void *set, char elem[]){ return rcuset_add(set, elem); }
+static int  ops_contains(void *set, char elem[]){ return rcuset_contains(set, elem); }
+static void ops_expand(void *set){ rcuset_expand(set); }
+static void ops_set_max_load(void *set, double max_load){ rcuset_set_max_load(set, max_load); }
+static void ops_free_fields(void *set){ rcuset_free_fields(set); }
+static void ops_write_elems_ordered(void *set, FILE *out){ rcuset_write_elems_ordered(set, out); }
+static void ops_show_structure(void *set){ rcuset_show_structure(set); }
+static void ops_save(void *set, char *filename){ rcuset_save(set, filename); }
+static int  ops_load(void *set, char *filename){ return rcuset_load(set, filename); }
+
+hashset_ops_t rcuset_ops = {
+  "rcu", sizeof(rcuset_t),
+  ops_init, ops_add, ops_contains, ops_expand, ops_set_max_load, ops_free_fields,
+  ops_write_elems_ordered, ops_show_structure, ops_save, ops_load,
+};
@@ -0,0 +1,274 @@
+// rhset_funcs.c: a hash set using open addressing with Robin Hood
+// displacement. Provides the same operations as the chained hash set
+// in hashset_funcs.c so hashset_main can run either one. Elements are
+// kept in a dense array in insertion order and the table itself is a
+// flat array of small slots referring to them, so a probe never
+// follows a pointer to another part of the heap.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hashset.h"
+
+// Initialize the Robin Hood set `rh` to have at least `table_size`
+// slots, rounded up to a power of two, and no elements. The maximum
+// load factor starts at RHSET_DEFAULT_MAX_LOAD.
+void rhset_init(rhset_t *rh, int table_size){
+  int size = 1;
+  while(size < table_size){
+    size *= 2;
+  }
+  rh->elem_count = 0;
+  rh->table_size = size;
+  rh->max_load = RHSET_DEFAULT_MAX_LOAD;
+  rh->slots = calloc(size, sizeof(rhslot_t));   // all slots empty
+  rh->entries = NULL;
+  rh->entries_cap = 0;
+  rh->keys.bytes = NULL;
+  rh->keys.len = 0;
+  rh->keys.cap = 0;
+}
+
+// Returns the distance of the element in slot `pos` from its home slot,
+// the slot its hash maps to; how far it was displaced by probing.
+static int rhset_probe_dist(rhset_t *rh, uint32_t hash, int pos){
+  return (pos - (int) (hash & (rh->table_size - 1))) & (rh->table_size - 1);
+}
+
+// Returns the index in `entries` of the `len` character string `elem`
+// with hash `hash` or -1 if it is not present. Probes from the home
+// slot of `hash`; the search stops at an empty slot or at a slot whose
+// element sits closer to its home than the search has come, as Robin
+// Hood insertion guarantees `elem` would have displaced it.
+static int rhset_find(rhset_t *rh, char elem[], int len, uint32_t hash){
+  int mask = rh->table_size - 1;
+  int pos = hash & mask;
+  for(int dist = 0; ; dist++){
+    rhslot_t *slot = &rh->slots[pos];
+    if(slot->entry == 0 || rhset_probe_dist(rh, slot->hash, pos) < dist){
+      return -1;
+    }
+    if(slot->hash == hash){
+      rhentry_t *entry = &rh->entries[slot->entry - 1];
+      if(entry->elem_len == len && memcmp(rh->keys.bytes + entry->elem_off, elem, len) == 0){
+        return slot->entry - 1;
+      }
+    }
+    pos = (pos + 1) & mask;
+  }
+}
+
+// Places the element at index `entry` of `entries` with hash `hash`
+// into the table. Walks forward from its home slot and whenever the
+// element being placed is further from home than the occupant of a
+// slot, swaps the two and carries on placing the displaced one. This
+// keeps probe distances even across elements. The caller ensures
+// there is an empty slot.
+static void rhset_place(rhset_t *rh, uint32_t hash, int entry){
+  int mask = rh->table_size - 1;
+  rhslot_t cur = {hash, entry + 1};
+  int pos = hash & mask;
+  for(int dist = 0; ; dist++){
+    rhslot_t *slot = &rh->slots[pos];
+    if(slot->entry == 0){
+      *slot = cur;
+      return;
+    }
+    int slot_dist = rhset_probe_dist(rh, slot->hash, pos);
+    if(slot_dist < dist){                         // rob the richer element of its slot
+      rhslot_t tmp = *slot;
+      *slot = cur;
+      cur = tmp;
+      dist = slot_dist;
+    }
+    pos = (pos + 1) & mask;
+  }
+}
+
+// Replaces the slots of `rh` with `new_size` empty slots and places
+// every element again in insertion order using its cached hash.
+static void rhset_resize(rhset_t *rh, int new_size){
+  free(rh->slots);
+  rh->slots = calloc(new_size, sizeof(rhslot_t));
+  rh->table_size = new_size;
+  for(int i = 0; i < rh->elem_count; i++){
+    rhset_place(rh, rh->entries[i].hash, i);
+  }
+}
+
+// Doubles the number of slots of `rh` and re-places every element.
+void rhset_expand(rhset_t *rh){
+  rhset_resize(rh, rh->table_size * 2);
+}
+
+// Sets the load factor past which rhset_add() expands `rh`. Open
+// addressing needs free slots to terminate probes so expansion can't
+// be turned off: values of 0 or less select RHSET_DEFAULT_MAX_LOAD and
+// values above RHSET_MAX_MAX_LOAD are capped. Expands right away if
+// `rh` is already over the new limit.
+void rhset_set_max_load(rhset_t *rh, double max_load){
+  if(max_load <= 0){
+    max_load = RHSET_DEFAULT_MAX_LOAD;
+  }
+  if(max_load > RHSET_MAX_MAX_LOAD){
+    max_load = RHSET_MAX_MAX_LOAD;
+  }
+  rh->max_load = max_load;
+  while(rh->elem_count > rh->max_load * rh->table_size){
+    rhset_expand(rh);
+  }
+}
+
+// Returns 1 if `elem` is in `rh` and 0 otherwise.
+int rhset_contains(rhset_t *rh, char elem[]){
+  int len = strlen(elem);
+  return rhset_find(rh, elem, len, (uint32_t) hashcode64(elem, len)) >= 0;
+}
+
+// Adds `elem` to `rh` and returns 1 or returns 0 if it is already
+// present. The element is appended to the `entries` array, which is
+// doubled as needed, and its string to the `keys` arena. If holding
+// one more element would exceed `max_load` the table is expanded
+// before the element is placed.
+int rhset_add(rhset_t *rh, char elem[]){
+  int len = strlen(elem);
+  uint32_t hash = (uint32_t) hashcode64(elem, len);
+  if(rhset_find(rh, elem, len, hash) >= 0){
+    return 0;
+  }
+  while(rh->elem_count + 1 > rh->max_load * rh->table_size){
+    rhset_expand(rh);
+  }
+  if(rh->elem_count == rh->entries_cap){
+    rh->entries_cap = rh->entries_cap == 0 ? RHSET_MIN_ENTRIES : rh->entries_cap * 2;
+    rh->entries = realloc(rh->entries, sizeof(rhentry_t) * rh->entries_cap);
+  }
+  rhentry_t *entry = &rh->entries[rh->elem_count];
+  entry->elem_off = strarena_add(&rh->keys, elem, len);
+  entry->elem_len = len;
+  entry->hash = hash;
+  rhset_place(rh, hash, rh->elem_count);
+  rh->elem_count++;
+  return 1;
+}
+
+// De-allocates the slots, entries and string arena of `rh` and sets
+// its fields to indicate it has no usable space. Does NOT free `rh`
+// itself.
+void rhset_free_fields(rhset_t *rh){
+  free(rh->slots);
+  rh->slots = NULL;
+  free(rh->entries);
+  rh->entries = NULL;
+  rh->entries_cap = 0;
+  strarena_free(&rh->keys);
+  rh->elem_count = 0;
+  rh->table_size = 0;
+}
+
+// Outputs all elements of `rh` in the order they were added, each on
+// its own line preceded by its add position, in the same format as
+// hashset_write_elems_ordered(). A sequential scan of `entries`.
+void rhset_write_elems_ordered(rhset_t *rh, FILE *out){
+  for(int i = 0; i < rh->elem_count; i++){
+    fprintf(out, "   %d %s\n", i+1, rh->keys.bytes + rh->entries[i].elem_off);
+  }
+}
+
+// Displays detailed structure of `rh`: the same stats as
+// hashset_show_structure() followed by one line per slot. Occupied
+// slots show the cached hash, the element and its probe distance from
+// its home slot:
+//
+// [ 5] : {-1491587362 Summer +1}
+void rhset_show_structure(rhset_t *rh){
+  printf("elem_count: %d\n", rh->elem_count);
+  printf("table_size: %d\n", rh->table_size);
+  if(rh->elem_count == 0){
+    printf("order_first: NULL\n");
+    printf("order_last : NULL\n");
+  }else{
+    printf("order_first: %s\n", rh->keys.bytes + rh->entries[0].elem_off);
+    printf("order_last : %s\n", rh->keys.bytes + rh->entries[rh->elem_count-1].elem_off);
+  }
+  printf("load_factor: %.4f\n", (double) rh->elem_count / rh->table_size);
+  for(int i = 0; i < rh->table_size; i++){
+    rhslot_t *slot = &rh->slots[i];
+    if(slot->entry == 0){
+      printf("[%2d] :\n", i);
+    }else{
+      printf("[%2d] : {%d %s +%d}\n", i, (int) slot->hash,
+             rh->keys.bytes + rh->entries[slot->entry - 1].elem_off,
+             rhset_probe_dist(rh, slot->hash, i));
+    }
+  }
+}
+
+// Writes `rh` to `filename` in the format of hashset_save() so the
+// files of either implementation can be loaded by the other.
+void rhset_save(rhset_t *rh, char *filename){
+  FILE *file = fopen(filename, "w");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  fprintf(file, "%d %d\n", rh->table_size, rh->elem_count);
+  rhset_write_elems_ordered(rh, file);
+  fclose(file);
+}
+
+// Loads a file written by rhset_save() or hashset_save() into `rh`,
+// replacing its contents. Prints an error and returns 0 if the file
+// cannot be opened, otherwise returns 1. The table is sized up front
+// from the header to hold every element under the current `max_load`,
+// which is kept.
+int rhset_load(rhset_t *rh, char *filename){
+  FILE *file = fopen(filename, "r");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  int size, count;
+  uint64_t seed[2];                             // hashcode64() takes no seed, ignored
+  hashset_read_header(file, &size, &count, seed);
+  double max_load = rh->max_load;
+  rhset_free_fields(rh);
+  rhset_init(rh, size);
+  rhset_set_max_load(rh, max_load);
+  int new_size = rh->table_size;
+  while(count > rh->max_load * new_size){
+    new_size *= 2;
+  }
+  if(new_size != rh->table_size){
+    rhset_resize(rh, new_size);
+  }
+  char *line = NULL;
+  size_t line_cap = 0;
+  char *elem;
+  for(int i = 0; i < count && hashset_read_elem(file, &line, &line_cap, &elem) >= 0; i++){
+    rhset_add(rh, elem);
+  }
+  free(line);
+  fclose(file);
+  return 1;
+}
+
+// Adapters from the generic hashset_ops_t interface to the functions
+// above.
+static void ops_init(void *set, int table_size){ rhset_init(set, table_size); }
+static int  ops_add(void *set, char elem[]){ return rhset_add(set, elem); }
+static int  ops_contains(void *set, char elem[]){ return rhset_contains(set, elem); }
+static void ops_expand(void *set){ rhset_expand(set); }
+static void ops_set_max_load(void *set, double max_load){ rhset_set_max_load(set, max_load); }
+static void ops_free_fields(void *set){ rhset_free_fields(set); }
+static void ops_write_elems_ordered(void *set, FILE *out){ rhset_write_elems_ordered(set, out); }
+static void ops_show_structure(void *set){ rhset_show_structure(set); }
+static void ops_save(void *set, char *filename){ rhset_save(set, filename); }
+static int  ops_load(void *set, char *filename){ return rhset_load(set, filename); }
+
+hashset_ops_t rhset_ops = {
+  "robin", sizeof(rhset_t),
+  ops_init, ops_add, ops_contains, ops_expand, ops_set_max_load, ops_free_fields,
+  ops_write_elems_ordered, ops_show_structure, ops_save, ops_load,
+};
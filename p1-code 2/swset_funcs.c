@@ -0,0 +1,298 @@
+// swset_funcs.c: a hash set using open addressing in the style of
+// SwissTable. Alongside the table of slots is an array with one control
+// byte per slot holding 7 bits of the hash of the element in it or a
+// marker for an empty slot. Lookups test a group of SWSET_GROUP_SIZE
+// control bytes at once, with a single SSE2 compare where available,
+// and only visit the elements whose 7 bits match. Most lookups of
+// absent elements therefore end after one group without comparing any
+// strings. Provides the same operations as the chained hash set in
+// hashset_funcs.c and keeps elements in insertion order like the Robin
+// Hood set in rhset_funcs.c.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hashset.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Returns the 7 bits of `hash` stored in the control byte of its slot.
+// Taken from the top of the hash as the low bits pick the group.
+static uint8_t swset_h2(uint32_t hash){
+  return hash >> 25;
+}
+
+// Returns a bit mask with bit i set when control byte i of the group at
+// `ctrl` equals `byte`.
+static uint32_t swset_group_match(uint8_t *ctrl, uint8_t byte){
+#ifdef __SSE2__
+  __m128i group = _mm_load_si128((__m128i *) ctrl);
+  __m128i cmp = _mm_cmpeq_epi8(group, _mm_set1_epi8((char) byte));
+  return (uint32_t) _mm_movemask_epi8(cmp);
+#else
+  uint32_t mask = 0;
+  for(int i = 0; i < SWSET_GROUP_SIZE; i++){
+    mask |= (uint32_t) (ctrl[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+// Initialize the SwissTable set `sw` to have at least `table_size`
+// slots, rounded up to a power of two of at least one group, and no
+// elements. The maximum load factor starts at SWSET_DEFAULT_MAX_LOAD.
+void swset_init(swset_t *sw, int table_size){
+  int size = SWSET_GROUP_SIZE;
+  while(size < table_size){
+    size *= 2;
+  }
+  sw->elem_count = 0;
+  sw->table_size = size;
+  sw->max_load = SWSET_DEFAULT_MAX_LOAD;
+  sw->ctrl = aligned_alloc(SWSET_GROUP_SIZE, size);  // groups are loaded with aligned loads
+  memset(sw->ctrl, SWSET_CTRL_EMPTY, size);
+  sw->slots = malloc(sizeof(uint32_t) * size);
+  sw->entries = NULL;
+  sw->entries_cap = 0;
+  sw->keys.bytes = NULL;
+  sw->keys.len = 0;
+  sw->keys.cap = 0;
+}
+
+// Returns the index in `entries` of the `len` character string `elem`
+// with hash `hash` or -1 if it is not present. Probes groups starting
+// at the one `hash` maps to, stepping 1, 2, 3... groups further each
+// time which visits every group of a power of two table. Only slots
+// whose control byte matches are compared and the search ends at the
+// first group with an empty slot as insertion would have used it.
+static int swset_find(swset_t *sw, char elem[], int len, uint32_t hash){
+  int group_mask = sw->table_size / SWSET_GROUP_SIZE - 1;
+  int group = hash & group_mask;
+  uint8_t h2 = swset_h2(hash);
+  for(int step = 1; ; step++){
+    uint8_t *ctrl = sw->ctrl + group * SWSET_GROUP_SIZE;
+    uint32_t match = swset_group_match(ctrl, h2);
+    while(match != 0){
+      int slot = group * SWSET_GROUP_SIZE + __builtin_ctz(match);
+      rhentry_t *entry = &sw->entries[sw->slots[slot]];
+      if(entry->hash == hash && entry->elem_len == len &&
+         memcmp(sw->keys.bytes + entry->elem_off, elem, len) == 0){
+        return sw->slots[slot];
+      }
+      match &= match - 1;                       // clear lowest set bit
+    }
+    if(swset_group_match(ctrl, SWSET_CTRL_EMPTY) != 0){
+      return -1;
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+// Places the element at index `entry` of `entries` with hash `hash`
+// into the first empty slot along its probe sequence. The caller
+// ensures there is an empty slot.
+static void swset_place(swset_t *sw, uint32_t hash, int entry){
+  int group_mask = sw->table_size / SWSET_GROUP_SIZE - 1;
+  int group = hash & group_mask;
+  for(int step = 1; ; step++){
+    uint32_t empty = swset_group_match(sw->ctrl + group * SWSET_GROUP_SIZE, SWSET_CTRL_EMPTY);
+    if(empty != 0){
+      int slot = group * SWSET_GROUP_SIZE + __builtin_ctz(empty);
+      sw->ctrl[slot] = swset_h2(hash);
+      sw->slots[slot] = entry;
+      return;
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+// Replaces the table of `sw` with `new_size` empty slots and places
+// every element again in insertion order using its cached hash.
+static void swset_resize(swset_t *sw, int new_size){
+  free(sw->ctrl);
+  free(sw->slots);
+  sw->ctrl = aligned_alloc(SWSET_GROUP_SIZE, new_size);
+  memset(sw->ctrl, SWSET_CTRL_EMPTY, new_size);
+  sw->slots = malloc(sizeof(uint32_t) * new_size);
+  sw->table_size = new_size;
+  for(int i = 0; i < sw->elem_count; i++){
+    swset_place(sw, sw->entries[i].hash, i);
+  }
+}
+
+// Doubles the number of slots of `sw` and re-places every element.
+void swset_expand(swset_t *sw){
+  swset_resize(sw, sw->table_size * 2);
+}
+
+// Sets the load factor past which swset_add() expands `sw`. As with the
+// Robin Hood set, expansion can't be turned off: values of 0 or less
+// select SWSET_DEFAULT_MAX_LOAD and values above SWSET_MAX_MAX_LOAD are
+// capped. Expands right away if `sw` is already over the new limit.
+void swset_set_max_load(swset_t *sw, double max_load){
+  if(max_load <= 0){
+    max_load = SWSET_DEFAULT_MAX_LOAD;
+  }
+  if(max_load > SWSET_MAX_MAX_LOAD){
+    max_load = SWSET_MAX_MAX_LOAD;
+  }
+  sw->max_load = max_load;
+  while(sw->elem_count > sw->max_load * sw->table_size){
+    swset_expand(sw);
+  }
+}
+
+// Returns 1 if `elem` is in `sw` and 0 otherwise.
+int swset_contains(swset_t *sw, char elem[]){
+  int len = strlen(elem);
+  return swset_find(sw, elem, len, (uint32_t) hashcode64(elem, len)) >= 0;
+}
+
+// Adds `elem` to `sw` and returns 1 or returns 0 if it is already
+// present. The element is appended to the `entries` array, which is
+// doubled as needed, and its string to the `keys` arena. If holding
+// one more element would exceed `max_load` the table is expanded
+// before the element is placed.
+int swset_add(swset_t *sw, char elem[]){
+  int len = strlen(elem);
+  uint32_t hash = (uint32_t) hashcode64(elem, len);
+  if(swset_find(sw, elem, len, hash) >= 0){
+    return 0;
+  }
+  while(sw->elem_count + 1 > sw->max_load * sw->table_size){
+    swset_expand(sw);
+  }
+  if(sw->elem_count == sw->entries_cap){
+    sw->entries_cap = sw->entries_cap == 0 ? RHSET_MIN_ENTRIES : sw->entries_cap * 2;
+    sw->entries = realloc(sw->entries, sizeof(rhentry_t) * sw->entries_cap);
+  }
+  rhentry_t *entry = &sw->entries[sw->elem_count];
+  entry->elem_off = strarena_add(&sw->keys, elem, len);
+  entry->elem_len = len;
+  entry->hash = hash;
+  swset_place(sw, hash, sw->elem_count);
+  sw->elem_count++;
+  return 1;
+}
+
+// De-allocates the table, entries and string arena of `sw` and sets
+// its fields to indicate it has no usable space. Does NOT free `sw`
+// itself.
+void swset_free_fields(swset_t *sw){
+  free(sw->ctrl);
+  sw->ctrl = NULL;
+  free(sw->slots);
+  sw->slots = NULL;
+  free(sw->entries);
+  sw->entries = NULL;
+  sw->entries_cap = 0;
+  strarena_free(&sw->keys);
+  sw->elem_count = 0;
+  sw->table_size = 0;
+}
+
+// Outputs all elements of `sw` in the order they were added, each on
+// its own line preceded by its add position, in the same format as
+// hashset_write_elems_ordered().
+void swset_write_elems_ordered(swset_t *sw, FILE *out){
+  for(int i = 0; i < sw->elem_count; i++){
+    fprintf(out, "   %d %s\n", i+1, sw->keys.bytes + sw->entries[i].elem_off);
+  }
+}
+
+// Displays detailed structure of `sw`: the same stats as
+// hashset_show_structure() followed by one line per slot. Occupied
+// slots show their control byte and element:
+//
+// [ 5] : {0x2c Summer}
+void swset_show_structure(swset_t *sw){
+  printf("elem_count: %d\n", sw->elem_count);
+  printf("table_size: %d\n", sw->table_size);
+  if(sw->elem_count == 0){
+    printf("order_first: NULL\n");
+    printf("order_last : NULL\n");
+  }else{
+    printf("order_first: %s\n", sw->keys.bytes + sw->entries[0].elem_off);
+    printf("order_last : %s\n", sw->keys.bytes + sw->entries[sw->elem_count-1].elem_off);
+  }
+  printf("load_factor: %.4f\n", (double) sw->elem_count / sw->table_size);
+  for(int i = 0; i < sw->table_size; i++){
+    if(sw->ctrl[i] == SWSET_CTRL_EMPTY){
+      printf("[%2d] :\n", i);
+    }else{
+      printf("[%2d] : {0x%02x %s}\n", i, sw->ctrl[i],
+             sw->keys.bytes + sw->entries[sw->slots[i]].elem_off);
+    }
+  }
+}
+
+// Writes `sw` to `filename` in the format of hashset_save() so the
+// files of any implementation can be loaded by the others.
+void swset_save(swset_t *sw, char *filename){
+  FILE *file = fopen(filename, "w");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return;
+  }
+  fprintf(file, "%d %d\n", sw->table_size, sw->elem_count);
+  swset_write_elems_ordered(sw, file);
+  fclose(file);
+}
+
+// Loads a file written by any implementation's save into `sw`,
+// replacing its contents. Prints an error and returns 0 if the file
+// cannot be opened, otherwise returns 1. The table is sized up front
+// from the header to hold every element under the current `max_load`,
+// which is kept.
+int swset_load(swset_t *sw, char *filename){
+  FILE *file = fopen(filename, "r");
+  if(file == NULL){
+    printf("ERROR: could not open file '%s'\n", filename);
+    return 0;
+  }
+  int size, count;
+  uint64_t seed[2];                             // hashcode64() takes no seed, ignored
+  hashset_read_header(file, &size, &count, seed);
+  double max_load = sw->max_load;
+  swset_free_fields(sw);
+  swset_init(sw, size);
+  swset_set_max_load(sw, max_load);
+  int new_size = sw->table_size;
+  while(count > sw->max_load * new_size){
+    new_size *= 2;
+  }
+  if(new_size != sw->table_size){
+    swset_resize(sw, new_size);
+  }
+  char *line = NULL;
+  size_t line_cap = 0;
+  char *elem;
+  for(int i = 0; i < count && hashset_read_elem(file, &line, &line_cap, &elem) >= 0; i++){
+    swset_add(sw, elem);
+  }
+  free(line);
+  fclose(file);
+  return 1;
+}
+
+// Adapters from the generic hashset_ops_t interface to the functions
+// above.
+static void ops_init(void *set, int table_size){ swset_init(set, table_size); }
+static int  ops_add(void *set, char elem[]){ return swset_add(set, elem); }
+static int  ops_contains(void *set, char elem[]){ return swset_contains(set, elem); }
+static void ops_expand(void *set){ swset_expand(set); }
+static void ops_set_max_load(void *set, double max_load){ swset_set_max_load(set, max_load); }
+static void ops_free_fields(void *set){ swset_free_fields(set); }
+static void ops_write_elems_ordered(void *set, FILE *out){ swset_write_elems_ordered(set, out); }
+static void ops_show_structure(void *set){ swset_show_structure(set); }
+static void ops_save(void *set, char *filename){ swset_save(set, filename); }
+static int  ops_load(void *set, char *filename){ return swset_load(set, filename); }
+
+hashset_ops_t swset_ops = {
+  "swiss", sizeof(swset_t),
+  ops_init, ops_add, ops_contains, ops_expand, ops_set_max_load, ops_free_fields,
+  ops_write_elems_ordered, ops_show_structure, ops_save, ops_load,
+};
@@ -0,0 +1,150 @@
+// Unit tests of the integer key hash sets in intset.h, run by
+// test_intset.org. Files are written to the test-results/ directory.
+
+#include <string.h>
+#include "intset.h"
+
+#define PRINT_TEST sprintf(sysbuf,"awk 'NR==(%d+1){P=1;print \"{\"} P==1 && /ENDTEST/{P=0; print \"}\"} P==1{print}' %s", __LINE__, __FILE__); \
+                   system(sysbuf);
+
+// Writes `contents` to the file `filename` for a load test.
+void write_file(char *filename, char *contents){
+  FILE *file = fopen(filename, "w");
+  fputs(contents, file);
+  fclose(file);
+}
+
+int main(int argc, char *argv[]){
+  if(argc < 2){
+    printf("usage: %s <test_name>\n", argv[0]);
+    return 1;
+  }
+  char *test_name = argv[1];
+  char sysbuf[1024];
+  system("mkdir -p test-results");
+
+  if(0){}
+
+  else if( strcmp( test_name, "u32set_order" )==0 ) {
+    PRINT_TEST;
+    // Adds keys including repeats and the largest 32-bit key to a
+    // u32set_t and checks each is added once and that ordered output
+    // lists them in the order they were first added.
+    u32set_t set;
+    u32set_init(&set, 4);
+    uint32_t keys[] = {7, 3, 7, 42, 3, 0, 4294967295U};
+    for(int i = 0; i < 7; i++){
+      int ret = u32set_add(&set, keys[i]);
+      printf("add %u: %d\n", keys[i], ret);
+    }
+    printf("elem_count: %d\n", set.elem_count);
+    printf("contains 42: %d\n", u32set_contains(&set, 42));
+    printf("contains 5:  %d\n", u32set_contains(&set, 5));
+    u32set_write_elems_ordered(&set, stdout);
+    u32set_free_fields(&set);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "u32set_save_load" )==0 ) {
+    PRINT_TEST;
+    // Saves a u32set_t with more keys than its table was made for and
+    // loads the file into a set with a smaller table and a lower
+    // max_load. The loaded set grows to hold the keys under its
+    // max_load and keeps their insertion order.
+    u32set_t set;
+    u32set_init(&set, 4);
+    for(uint32_t key = 20; key > 0; key--){
+      u32set_add(&set, key * 1000);
+    }
+    u32set_save(&set, "test-results/u32set1.tmp");
+    u32set_t loaded;
+    u32set_init(&loaded, 2);
+    u32set_set_max_load(&loaded, 0.5);
+    int ret = u32set_load(&loaded, "test-results/u32set1.tmp");
+    printf("ret: %d\n", ret);
+    printf("elem_count: %d\n", loaded.elem_count);
+    printf("table_size: %d\n", loaded.table_size);
+    printf("max_load: %.2f\n", loaded.max_load);
+    printf("contains 7000: %d\n", u32set_contains(&loaded, 7000));
+    printf("contains 7001: %d\n", u32set_contains(&loaded, 7001));
+    u32set_write_elems_ordered(&loaded, stdout);
+    u32set_free_fields(&loaded);
+    u32set_free_fields(&set);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "u64set_save_load" )==0 ) {
+    PRINT_TEST;
+    // Round trips keys too large for 32 bits through u64set_save()
+    // and u64set_load(), which replaces the keys already in the set.
+    u64set_t set;
+    u64set_init(&set, 8);
+    u64set_add(&set, 18446744073709551615ULL);
+    u64set_add(&set, 1);
+    u64set_add(&set, 1099511627776ULL);
+    u64set_add(&set, 4294967296ULL);
+    u64set_save(&set, "test-results/u64set1.tmp");
+    u64set_t loaded;
+    u64set_init(&loaded, 8);
+    u64set_add(&loaded, 99);
+    int ret = u64set_load(&loaded, "test-results/u64set1.tmp");
+    printf("ret: %d\n", ret);
+    printf("elem_count: %d\n", loaded.elem_count);
+    printf("contains 4294967296: %d\n", u64set_contains(&loaded, 4294967296ULL));
+    printf("contains 0:          %d\n", u64set_contains(&loaded, 0));
+    printf("contains 99:         %d\n", u64set_contains(&loaded, 99));
+    u64set_write_elems_ordered(&loaded, stdout);
+    u64set_free_fields(&loaded);
+    u64set_free_fields(&set);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "u32set_load_bad" )==0 ) {
+    PRINT_TEST;
+    // Loads files holding elements that aren't 32-bit keys: words,
+    // numbers with trailing characters, negative numbers and numbers
+    // too large for 32 bits. Each load fails and leaves the set as it
+    // was.
+    u32set_t set;
+    u32set_init(&set, 4);
+    u32set_add(&set, 10);
+    u32set_add(&set, 20);
+    char *files[] = {
+      "4 3\n   1 5\n   2 Rick\n   3 9\n",
+      "4 2\n   1 5\n   2 12abc\n",
+      "4 2\n   1 5\n   2 -1\n",
+      "4 2\n   1 5\n   2 4294967296\n",
+    };
+    for(int i = 0; i < 4; i++){
+      write_file("test-results/u32set2.tmp", files[i]);
+      int ret = u32set_load(&set, "test-results/u32set2.tmp");
+      printf("ret: %d\n", ret);
+    }
+    int ret = u32set_load(&set, "test-results/not-there.tmp");
+    printf("ret: %d\n", ret);
+    printf("elem_count: %d\n", set.elem_count);
+    u32set_write_elems_ordered(&set, stdout);
+    u32set_free_fields(&set);
+  } // ENDTEST
+
+  else if( strcmp( test_name, "u64set_load_bad" )==0 ) {
+    PRINT_TEST;
+    // Loads a file with the largest 64-bit key, which succeeds, then
+    // one with a number one larger, which fails and leaves the set
+    // as it was.
+    u64set_t set;
+    u64set_init(&set, 4);
+    write_file("test-results/u64set2.tmp", "4 2\n   1 7\n   2 18446744073709551615\n");
+    int ret = u64set_load(&set, "test-results/u64set2.tmp");
+    printf("ret: %d\n", ret);
+    write_file("test-results/u64set2.tmp", "4 2\n   1 7\n   2 18446744073709551616\n");
+    ret = u64set_load(&set, "test-results/u64set2.tmp");
+    printf("ret: %d\n", ret);
+    printf("elem_count: %d\n", set.elem_count);
+    u64set_write_elems_ordered(&set, stdout);
+    u64set_free_fields(&set);
+  } // ENDTEST
+
+  else{
+    printf("No test named '%s' found\n",test_name);
+    return 1;
+  }
+  return 0;
+}